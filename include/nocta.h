@@ -8,8 +8,31 @@
 // Every sound unit refers to an instance of this
 typedef struct {
 	int sample_rate;
+	
+	// the kind of arithmetic used by the units (see the backends below)
+	// this must be set before any units are created
+	int backend;
+	
+	// lookup tables shared by the units, built when first needed
+	struct nocta_tables* tables;
+	
+	// scheduled events (see nocta_schedule)
+	struct nocta_events* events;
+	
+	// block buffers used by the context's graphs (see nocta_graph_build)
+	struct nocta_pool* pool;
 } nocta_context;
 
+// Free a context's lookup tables and buffers (once all of its units and graphs are freed)
+void nocta_context_free(nocta_context* context);
+
+// backends:
+enum {
+	NOCTA_BACKEND_FIXED,    // 3:13 fixed point (the default, for embedded targets)
+	NOCTA_BACKEND_FLOAT,    // 32-bit float, for CPUs with fast vector floating point
+	NOCTA_NUM_BACKENDS
+};
+
 // A sound processing object
 struct nocta_unit;
 typedef struct nocta_unit nocta_unit;
@@ -29,8 +52,45 @@ struct nocta_unit {
 	int (*process_r)(nocta_unit* self, int r);
 	void (*free)(nocta_unit* self);
 	
+	// optional: process a block of interleaved stereo samples in one go
+	// (output must already be clipped to 16 bits)
+	void (*process_buffer)(nocta_unit* self, int16_t* buffer, size_t length);
+	
+	// optional: float version of process_buffer, used by the float backend
+	// (samples are from -1.0 to 1.0, and aren't clipped)
+	void (*process_float)(nocta_unit* self, float* buffer, size_t length);
+	
+	// optional: start or stop a note, for units which play them
+	void (*note)(nocta_unit* self, int note, bool on);
+	
 	nocta_param* params;
 	int num_params;
+	
+	// optional: number of bytes at the start of `data` which hold the
+	// parameters and anything derived from them, but no pointers or state
+	// (the setters must not write outside of this region)
+	size_t preset_size;
+	
+	// copy of that region as the unit was created, which presets are prepared from
+	void* initial_data;
+	
+	// preset waiting to be applied at the start of the next block
+	const void* pending_preset;
+	
+	// number of frames processed so far
+	uint32_t time;
+	
+	// position of the current span within the block being processed
+	// (where the unit's modulation buffers are read from)
+	size_t block_pos;
+	
+	// automation lanes (see nocta_automate): the ones being played, a new set
+	// waiting to take over at the start of the next call to process the unit,
+	// old sets handed back to be freed, and the newest set made
+	struct nocta_automation* automation;
+	struct nocta_automation* pending_automation;
+	struct nocta_automation* retired_automation;
+	struct nocta_automation* latest_automation;
 };
 
 struct nocta_param {
@@ -38,6 +98,9 @@ struct nocta_param {
 	int min, max;
 	int (*get)(nocta_unit* unit);
 	void (*set)(nocta_unit* unit, int val);
+	
+	// optional: follow a buffer of per-frame values (NULL to stop)
+	void (*modulate)(nocta_unit* unit, const int* values);
 };
 
 // Create a new sound unit
@@ -55,6 +118,10 @@ void nocta_process_mono(nocta_unit* self, int16_t* l);
 // Process a block of interleaved stereo samples
 void nocta_process_buffer(nocta_unit* self, int16_t* buffer, size_t length);
 
+// Process a block of interleaved stereo float samples, from -1.0 to 1.0
+// with the float backend, this avoids converting to 16 bits between units
+void nocta_process_float(nocta_unit* self, float* buffer, size_t length);
+
 // Get/set the value of a parameter
 int nocta_get(nocta_unit* self, int param_id);
 void nocta_set(nocta_unit* self, int param_id, int val);
@@ -62,6 +129,185 @@ void nocta_set(nocta_unit* self, int param_id, int val);
 // Get a parameter's definition
 nocta_param* nocta_get_param(nocta_unit* self, int param_id);
 
+// Start or stop a MIDI note (where 69 = A4) on a unit which plays notes,
+// such as an oscillator or a sampler
+// returns false if the unit doesn't play notes
+bool nocta_note_on(nocta_unit* self, int note);
+bool nocta_note_off(nocta_unit* self, int note);
+
+// Modulate a parameter at audio rate, from a buffer holding a value for each
+// frame of a block (in the same units as nocta_set, but not clamped)
+// the buffer is read from the start on every block, so it must be at least as
+// long as the blocks, and can be refilled in between; pass NULL to stop
+// (nocta_process and nocta_process_mono read the first value)
+// returns false if the parameter can't be modulated
+// supported by: filter frequency, gainer volume and pan, and delay time
+bool nocta_modulate(nocta_unit* self, int param_id, const int* values);
+
+// Automation:
+// a lane moves a parameter along a curve through a list of breakpoints,
+// as the unit processes
+typedef struct {
+	uint32_t time;      // in frames from the start of the lane
+	int32_t value;
+	int32_t curve;      // shape of the curve to the next breakpoint (see below)
+} nocta_breakpoint;
+
+enum {
+	NOCTA_CURVE_LINEAR,
+	NOCTA_CURVE_EXPONENTIAL,  // for values from 1 to 32767 (otherwise linear)
+	NOCTA_CURVE_HOLD          // stay at this value until the next breakpoint
+};
+
+// Automate a parameter from the unit's next block, replacing any lane it had
+// (a count of 0 removes the lane)
+// the breakpoints must be sorted by time, and are copied; the lane stays at
+// the first value until its time, and at the last value after the end
+// parameters which can be modulated follow the curve on every frame, using
+// their modulation buffer, and the others are set at most every 256 frames
+// this can be called from another thread while the unit is being processed
+// (but only one at a time): the lanes take over when it next starts a block
+// returns false if the parameter doesn't exist, or the breakpoints aren't sorted
+bool nocta_automate(nocta_unit* self, int param_id, const nocta_breakpoint* points, int count);
+
+// Set a parameter `offset` frames into the unit's next block (or later),
+// splitting the block there so the change is sample accurate
+// events are queued on the context, so call this from the processing thread
+// returns false if the queue is full
+bool nocta_schedule(nocta_unit* self, uint32_t offset, int param_id, int val);
+
+// Remove all of a unit's scheduled events
+void nocta_cancel(nocta_unit* self);
+
+
+// Graphs:
+// route units into each other, with the buffers in between owned by the context
+// a node is a unit, or a plain mixing point (NULL), and its input is the sum
+// of everything connected to it
+// graphs on the same context share buffers, so they must be processed one at a time
+typedef struct nocta_graph nocta_graph;
+
+enum {
+	NOCTA_GRAPH_INPUT,      // node holding the block passed to nocta_graph_process
+	NOCTA_GRAPH_OUTPUT      // node whose output is written back to it
+};
+
+nocta_graph* nocta_graph_create(nocta_context* context);
+
+// Free a graph (but not its units)
+void nocta_graph_free(nocta_graph* graph);
+
+// Add a node, and return its id
+int nocta_graph_add(nocta_graph* graph, nocta_unit* unit);
+
+// Feed the output of one node into another
+bool nocta_graph_connect(nocta_graph* graph, int from, int to);
+
+// Sort the nodes and assign their buffers, for blocks of up to `max_length` samples
+// call this after adding nodes or connections, and before processing
+// returns false if the connections form a loop
+bool nocta_graph_build(nocta_graph* graph, size_t max_length);
+
+// The same, and also fuse runs of gainers in a chain into a single multiply,
+// or into the volume of a bqfilter or svfilter that follows them
+// (which rounds slightly differently from processing them one by one, only
+// clips once at the end of the run, and a filter then changes its volume at
+// once when a gain before it changes)
+bool nocta_graph_compile(nocta_graph* graph, size_t max_length);
+
+// Process a block of interleaved stereo samples through the graph, in place
+void nocta_graph_process(nocta_graph* graph, int16_t* buffer, size_t length);
+
+// Number of pool buffers the graph uses (besides the block being processed)
+int nocta_graph_buffers(nocta_graph* graph);
+
+
+// Presets:
+// a compact blob holding all of a unit's parameters, along with everything
+// the unit derives from them (e.g. filter coefficients), so it can be
+// recalled instantly. It's plain memory, so it can be saved or loaded as is.
+
+// Number of bytes needed to store a preset for this unit
+size_t nocta_preset_size(nocta_unit* self);
+
+// Store the unit's current settings in a preset
+// this reads the unit's data, so call it from the thread that processes the
+// unit, or while it isn't processing
+void nocta_preset_capture(nocta_unit* self, void* preset);
+
+// Build a preset from a list of values (one per parameter)
+// anything that isn't a parameter is left as the unit was created, and the
+// unit itself isn't read or changed, so this can be called on any thread
+void nocta_preset_prepare(nocta_unit* self, void* preset, const int* values);
+
+// Check that a preset (e.g. loaded from a file) is usable with this unit
+// if it came from another build of nocta, rebuild it with nocta_preset_prepare
+bool nocta_preset_check(nocta_unit* self, const void* preset, size_t size);
+
+// Get a parameter value stored in a preset
+int nocta_preset_get(const void* preset, int param_id);
+
+// Switch the unit to a preset at the start of its next block
+// all parameters change at once, without calling setters or allocating memory
+// the preset must stay alive until nocta_preset_pending returns false
+void nocta_preset_recall(nocta_unit* self, const void* preset);
+bool nocta_preset_pending(nocta_unit* self);
+
+
+// Render-ahead streams:
+// run the processing on a worker thread, a few blocks ahead of the audio
+// callback, which then only has to copy the samples out; a slow block only
+// causes a dropout if it uses up all the blocks in hand, so more blocks
+// trade latency for robustness (needs POSIX threads)
+typedef struct nocta_stream nocta_stream;
+
+// fill a block of interleaved stereo samples (which starts out silent)
+typedef void (*nocta_render_cb)(void* user, int16_t* buffer, size_t length);
+
+// Start rendering blocks of `block` samples, keeping up to `blocks` of them ready
+// the first ones are rendered before this returns
+// returns NULL if the thread can't be started
+nocta_stream* nocta_stream_start(nocta_context* context, nocta_render_cb render, void* user,
+                                 size_t block, int blocks);
+
+// Stop the worker thread, and free the stream
+void nocta_stream_stop(nocta_stream* stream);
+
+// Copy the next samples out, from the audio callback (this never waits)
+// if not enough are ready, the rest is filled with silence and counted as an underrun
+// returns the number of samples that were ready
+size_t nocta_stream_read(nocta_stream* stream, int16_t* buffer, size_t length);
+
+// Number of samples ready to be read
+size_t nocta_stream_buffered(nocta_stream* stream);
+
+// Number of reads which came up short so far
+uint32_t nocta_stream_underruns(nocta_stream* stream);
+
+
+// Real-time checks:
+// in a build with NOCTA_RTCHECK defined (make RTCHECK=1), the processing calls
+// (nocta_process_buffer, nocta_graph_process, etc.) report any memory
+// allocation, lock, blocking wait or file access made while they run, on
+// stderr, and keep track of the longest one. This is for debugging only, as
+// it replaces malloc and friends for the whole program.
+typedef struct {
+	uint32_t violations;   // number of calls reported
+	const char* last;      // name of the last call reported
+	uint64_t regions;      // number of processing calls timed
+	double worst;          // longest processing call, in seconds
+	double worst_load;     // most CPU time a call took for the audio it produced
+	                       // (1.0 is real time; calls for under 1 ms aren't counted)
+} nocta_rtcheck_stats;
+
+// Get the results so far
+// returns false if nocta wasn't built with the checks
+bool nocta_rtcheck_read(nocta_rtcheck_stats* stats);
+void nocta_rtcheck_reset(void);
+
+// Abort as soon as a call is reported, instead of carrying on
+void nocta_rtcheck_abort(bool enable);
+
 
 // Gainer:
 // amplifies or attenuates a sound signal
@@ -103,6 +349,34 @@ enum {
 	NOCTA_FILTER_NUM_MODES
 };
 
+// Filter bank:
+// up to 32 bands, spaced evenly on a log scale from the low to the high frequency
+// parallel mode mixes bandpass filters by each band's gain (vocoders, analysis)
+// series mode chains peaking filters which boost or cut each band (graphic EQ),
+// adding a latency of (bands-1) samples
+nocta_unit* nocta_filterbank(nocta_context* context);
+
+// Get/set the gain of a band, from 0 to 255 where 128 = 100%
+// (in series mode this ranges from -12 dB to +12 dB)
+void nocta_filterbank_set_gain(nocta_unit* bank, int band, int gain);
+int nocta_filterbank_get_gain(nocta_unit* bank, int band);
+
+enum {
+	NOCTA_FILTERBANK_VOL,   // amplitude from 0 to 255, where 128 = 100%
+	NOCTA_FILTERBANK_MODE,  // parallel or series
+	NOCTA_FILTERBANK_BANDS, // number of bands, from 1 to 32
+	NOCTA_FILTERBANK_LOW,   // frequency of the lowest band
+	NOCTA_FILTERBANK_HIGH,  // frequency of the highest band
+	NOCTA_FILTERBANK_RES,   // resonance, from 0 (wide bands) to 255 (narrow bands)
+	NOCTA_FILTERBANK_NUM_PARAMS
+};
+
+enum {
+	NOCTA_FILTERBANK_PARALLEL,
+	NOCTA_FILTERBANK_SERIES,
+	NOCTA_FILTERBANK_NUM_MODES
+};
+
 // Delay/echo:
 nocta_unit* nocta_delay(nocta_context* context);
 
@@ -114,18 +388,241 @@ enum {
 	NOCTA_DELAY_NUM_PARAMS
 };
 
+// Chorus, flanger and vibrato:
+// a short delay whose time is swept by a triangle LFO
+// they are the same unit with different default settings
+nocta_unit* nocta_chorus(nocta_context* context);
+nocta_unit* nocta_flanger(nocta_context* context);
+nocta_unit* nocta_vibrato(nocta_context* context);
+
+enum {
+	NOCTA_CHORUS_DRY,
+	NOCTA_CHORUS_WET,
+	NOCTA_CHORUS_FEEDBACK,
+	NOCTA_CHORUS_DELAY,     // centre delay time, in tenths of a millisecond (1 to 500)
+	NOCTA_CHORUS_DEPTH,     // how far the delay time is swept, from 0 (none) to 255 (full)
+	NOCTA_CHORUS_RATE,      // LFO rate, in hundredths of a hertz (1 to 1000)
+	NOCTA_CHORUS_NUM_PARAMS
+};
+
+// Pitch shifter:
+// overlapping grains of the input, played back faster or slower and
+// spliced where the waveforms line up (WSOLA)
+nocta_unit* nocta_pitch(nocta_context* context);
+
+enum {
+	NOCTA_PITCH_DRY,
+	NOCTA_PITCH_WET,
+	NOCTA_PITCH_SHIFT,      // in cents (-1200 to 1200)
+	NOCTA_PITCH_GRAIN,      // grain length, in milliseconds (10 to 100)
+	NOCTA_PITCH_NUM_PARAMS
+};
+
+// Reverb:
+// feedback delay network with 8 damped delay lines
+nocta_unit* nocta_reverb(nocta_context* context);
+
+enum {
+	NOCTA_REVERB_DRY,
+	NOCTA_REVERB_WET,
+	NOCTA_REVERB_SIZE,      // room size, from 0 (small) to 255 (large)
+	NOCTA_REVERB_DECAY,     // feedback amount, from 0 (short) to 255 (long)
+	NOCTA_REVERB_DAMPING,   // high frequency loss, from 0 (bright) to 255 (dark)
+	NOCTA_REVERB_NUM_PARAMS
+};
+
+// Compressor and limiter:
+// reduce the level of loud sounds, following the peak of both channels
+// the limiter keeps peaks under the threshold by looking ahead, which delays
+// the sound by the lookahead time
+nocta_unit* nocta_compressor(nocta_context* context);
+nocta_unit* nocta_limiter(nocta_context* context);
+
+enum {
+	NOCTA_DYNAMICS_MODE,      // compressor or limiter
+	NOCTA_DYNAMICS_THRESHOLD, // level where reduction starts, from 0 to 60 dB below full scale
+	NOCTA_DYNAMICS_RATIO,     // compression ratio, from 1 (none) to 20 (ignored by the limiter)
+	NOCTA_DYNAMICS_ATTACK,    // time to reach a lower gain, from 0 to 200 ms (ignored by the limiter)
+	NOCTA_DYNAMICS_RELEASE,   // time to recover, from 1 to 2000 ms
+	NOCTA_DYNAMICS_LOOKAHEAD, // from 0 to 10 ms
+	NOCTA_DYNAMICS_GAIN,      // makeup gain, from 0 to 24 dB
+	NOCTA_DYNAMICS_NUM_PARAMS
+};
+
+enum {
+	NOCTA_DYNAMICS_COMPRESSOR,
+	NOCTA_DYNAMICS_LIMITER,
+	NOCTA_DYNAMICS_NUM_MODES
+};
+
+// Meter:
+// passes the sound through, measuring its level
+// the levels can be read from any thread, without blocking the audio thread
+nocta_unit* nocta_meter(nocta_context* context);
+
+typedef struct {
+	int peak_l, peak_r;    // largest sample values, from 0 to 32768
+	int rms_l, rms_r;      // root mean square levels, from 0 to 32768
+	uint32_t clips;        // number of samples at full scale so far
+	uint32_t count;        // number of times the levels have been updated
+} nocta_meter_levels;
+
+// Get the levels measured over the most recent period
+void nocta_meter_read(nocta_unit* meter, nocta_meter_levels* levels);
+
+enum {
+	NOCTA_METER_PERIOD,     // time between updates, from 0 (every block) to 1000 ms
+	NOCTA_METER_NUM_PARAMS
+};
+
+// Analyzer:
+// passes the sound through, measuring the spectrum of its mono mix with an FFT
+// the spectrum can be read from any one thread, without blocking the audio thread
+nocta_unit* nocta_analyzer(nocta_context* context);
+
+typedef struct {
+	const float* bins;     // magnitudes, where a full scale sine wave is 1.0
+	int count;             // number of bins, from 0 Hz up to half the sample rate
+	uint32_t serial;       // number of spectra measured so far
+} nocta_spectrum;
+
+// Get the most recent spectrum (count is 0 until the first one)
+// the bins stay valid until the next call
+void nocta_analyzer_read(nocta_unit* analyzer, nocta_spectrum* spectrum);
+
+enum {
+	NOCTA_ANALYZER_SIZE,    // frame size, as a power of 2 (8 to 12, i.e. 256 to 4096 samples)
+	NOCTA_ANALYZER_HOP,     // frames between measurements (16 to 65536)
+	NOCTA_ANALYZER_NUM_PARAMS
+};
+
+// Noise generator:
+// adds white, pink or brown noise to the signal
+// every instance has its own random number generator, so a render can
+// be repeated exactly by seeding it first
+nocta_unit* nocta_noise(nocta_context* context);
+void nocta_noise_seed(nocta_unit* noise, uint32_t seed);
+
+enum {
+	NOCTA_NOISE_VOL,        // amplitude from 0 to 255
+	NOCTA_NOISE_COLOR,      // see the noise colors below
+	NOCTA_NOISE_NUM_PARAMS
+};
+
+enum {
+	NOCTA_NOISE_WHITE,      // equal energy at every frequency
+	NOCTA_NOISE_PINK,       // equal energy in every octave (-3 dB/octave)
+	NOCTA_NOISE_BROWN,      // -6 dB/octave
+	NOCTA_NOISE_NUM_COLORS
+};
+
+
+// Sample banks:
+// a file of 16-bit mono samples, mapped into memory so it only has to be read
+// from disk as it's played, and shared by any number of samplers
+// either a WAV file, or raw samples at the given sample rate
+typedef struct nocta_bank nocta_bank;
+
+// returns NULL if the file can't be opened, or isn't 16-bit mono
+nocta_bank* nocta_bank_open(const char* path, int sample_rate);
+
+// Close a bank (once all of its samplers are freed)
+void nocta_bank_close(nocta_bank* bank);
+
+// Number of samples in the bank
+uint32_t nocta_bank_length(nocta_bank* bank);
+
+// Ask for part of the bank to be read from disk in the background, so that
+// playing it later doesn't have to wait (e.g. before a sequence uses it)
+void nocta_bank_prefetch(nocta_bank* bank, uint32_t start, uint32_t length);
+
+// Sampler:
+// plays a region of a bank, pitched by note (see nocta_note_on), and mixed
+// into both channels; up to 32 notes at a time, after which the oldest stops
+// a note off stops the note looping, so it plays out to the end of the region
+nocta_unit* nocta_sampler(nocta_context* context, nocta_bank* bank);
+
+// Silence all notes
+void nocta_sampler_stop(nocta_unit* sampler);
+
+enum {
+	NOCTA_SAMPLER_VOL,          // amplitude from 0 to 255, where 128 = 100%
+	NOCTA_SAMPLER_ROOT,         // note which plays the samples at their own pitch
+	NOCTA_SAMPLER_START,        // first sample of the region in the bank
+	NOCTA_SAMPLER_LENGTH,       // in samples (0 for the rest of the bank)
+	NOCTA_SAMPLER_LOOP_START,   // from the start of the region
+	NOCTA_SAMPLER_LOOP_LENGTH,  // in samples (0 to play through once)
+	NOCTA_SAMPLER_NUM_PARAMS
+};
+
+// Sequencer:
+// plays a stream of note and parameter events through tracks of units,
+// rendering as far ahead as it's asked to (e.g. offline, or into a large buffer)
+// each track is a chain of units starting with the one that plays its notes
+// (an oscillator or a sampler)
+// tracks are mixed through a compiled graph, so the same restrictions apply (see above)
+typedef struct nocta_seq nocta_seq;
+
+#define NOCTA_SEQ_MAX_TRACKS 256
+#define NOCTA_SEQ_MAX_UNITS 8     // per track
+
+typedef struct {
+	uint32_t time;      // in ticks from the start of the sequence
+	int16_t value;      // note number or parameter value
+	uint8_t track;
+	uint8_t command;    // see the commands below
+} nocta_seq_event;
+
+// commands:
+enum {
+	NOCTA_SEQ_NOTE_ON,      // play a note on the track's first unit
+	NOCTA_SEQ_NOTE_OFF,
+	NOCTA_SEQ_END           // does nothing, but marks the length of a loop
+};
+
+// set parameter `param` of the track's unit number `unit` (0 is the first)
+#define NOCTA_SEQ_SET(unit, param) (0x80 | (unit) << 4 | (param))
+
+nocta_seq* nocta_seq_create(nocta_context* context);
+
+// Free a sequencer (but not its units)
+void nocta_seq_free(nocta_seq* seq);
+
+// Add a track, made of `count` units chained together, and return its id
+// (or -1 if there are too many tracks or units)
+int nocta_seq_track(nocta_seq* seq, nocta_unit** units, int count);
+
+// Set the length of a tick in frames (1 by default, so times are in frames)
+void nocta_seq_tick(nocta_seq* seq, uint32_t frames);
+
+// Start playing a list of events, sorted by time
+// the events aren't copied, so they must stay alive while playing
+// a looping sequence starts over at the time of its last event
+void nocta_seq_play(nocta_seq* seq, const nocta_seq_event* events, int count, bool loop);
+void nocta_seq_stop(nocta_seq* seq);
+
+// Whether there are still events to play
+bool nocta_seq_playing(nocta_seq* seq);
+
+// Render a block of interleaved stereo samples, mixed into the buffer
+// (the units keep running after the sequence ends, so notes can ring out)
+void nocta_seq_render(nocta_seq* seq, int16_t* buffer, size_t length);
 
 // WIP STUFF:
 
 nocta_unit* nocta_osc(nocta_context* context);
 void nocta_osc_on(nocta_unit* osc);
 void nocta_osc_off(nocta_unit* osc);
+void nocta_osc_note(nocta_unit* osc, int note); // set the note and switch it on
+void nocta_osc_seed(nocta_unit* osc, uint32_t seed); // for the noise wave
 
 enum {
 	NOCTA_OSC_ACTIVE,
 	NOCTA_OSC_VOL,
 	NOCTA_OSC_FREQ,
 	NOCTA_OSC_WAVE,
+	NOCTA_OSC_NOTE,         // MIDI note number, where 69 = A4 (440 Hz)
+	NOCTA_OSC_FINE,         // fine tuning, from -100 to 100 cents
 	NOCTA_OSC_NUM_PARAMS
 };
 
@@ -0,0 +1,320 @@
+#include "common.h"
+#include "tables.h"
+
+// Spectrum analyzer.
+// Passes the sound through unchanged, keeping the most recent frame of the
+// mono mix. Every `hop` frames, it's windowed and run through a real FFT:
+// the even and odd samples are packed into a complex FFT of half the size,
+// which is unpacked afterwards. The complex FFT keeps the real and imaginary
+// parts in separate arrays, and each butterfly size has its own run of
+// twiddle factors, so the butterflies of a stage are plain loops over
+// consecutive floats, which are worked out LANES at a time so the compiler
+// can vectorize them.
+// The magnitudes are published through a triple buffer: the audio thread
+// fills its own copy and swaps it with the middle one, and the reader swaps
+// the middle one with its own when there's a new one, so neither side ever
+// waits or sees a copy that's being written.
+
+#define MIN_BITS 8
+#define MAX_BITS FFT_BITS
+#define HALF_BITS (FFT_BITS - 1)   // bits of the largest complex FFT
+#define MAX_BINS (FFT_SIZE / 2 + 1)
+#define FRESH 4    // set on `middle` when it holds a spectrum the reader hasn't seen
+#define LANES 4    // butterflies worked out side by side
+
+static int get_size(nocta_unit* self);
+static void set_size(nocta_unit* self, int size);
+static int get_hop(nocta_unit* self);
+static void set_hop(nocta_unit* self, int hop);
+
+static nocta_param analyzer_params[] = {
+	{"size", MIN_BITS, MAX_BITS, get_size, set_size},
+	{"hop", 16, 65536, get_hop, set_hop}
+};
+
+typedef struct {
+	int count;
+	uint32_t serial;
+	float bins[MAX_BINS];
+} spectrum;
+
+typedef struct {
+	// parameters (captured by presets):
+	int bits;         // frame size, as a power of 2
+	int hop;
+
+	// state:
+	float* history;   // ring of the last FFT_SIZE mono samples
+	uint32_t pos;
+	int countdown;    // frames until the next analysis
+	float last_l;     // left input of the current frame, for process_r
+	float* re;        // FFT workspace
+	float* im;
+	uint32_t serial;
+	struct nocta_tables* tables;
+
+	// triple buffer:
+	spectrum* spectra;
+	int back;         // only used by the audio thread
+	int middle;       // swapped by both (only accessed atomically)
+	int front;        // only used by the reader
+} analyzer_data;
+
+static void build_tables(nocta_context* context);
+static int analyzer_l(nocta_unit* self, int x);
+static int analyzer_r(nocta_unit* self, int x);
+static void analyzer_buffer(nocta_unit* self, int16_t* buffer, size_t length);
+static void analyzer_float(nocta_unit* self, float* buffer, size_t length);
+static void analyzer_free(nocta_unit* self);
+
+nocta_unit* nocta_analyzer(nocta_context* context) {
+
+	build_tables(context);
+
+	nocta_unit* self = nocta_create(
+		.context = context,
+		.name = "analyzer",
+		.data = ialloc(analyzer_data,
+			.history = calloc(FFT_SIZE, sizeof(float)),
+			.re = malloc(FFT_SIZE / 2 * sizeof(float)),
+			.im = malloc(FFT_SIZE / 2 * sizeof(float)),
+			.tables = get_tables(context),
+			.spectra = calloc(3, sizeof(spectrum)),
+			.back = 0,
+			.middle = 1,
+			.front = 2
+		),
+		.process_l = analyzer_l,
+		.process_r = analyzer_r,
+		.process_buffer = analyzer_buffer,
+		.process_float = analyzer_float,
+		.free = analyzer_free,
+		.params = analyzer_params,
+		.num_params = NOCTA_ANALYZER_NUM_PARAMS,
+		.preset_size = offsetof(analyzer_data, history)
+	);
+
+	set_size(self, 10);
+	set_hop(self, 512);
+	analyzer_data* data = self->data;
+	data->countdown = data->hop;
+	preset_snapshot(self);
+	return self;
+}
+
+static void analyzer_free(nocta_unit* self) {
+	analyzer_data* data = self->data;
+	free(data->history);
+	free(data->re);
+	free(data->im);
+	free(data->spectra);
+}
+
+void nocta_analyzer_read(nocta_unit* self, nocta_spectrum* result) {
+	analyzer_data* data = self->data;
+	if (__atomic_load_n(&data->middle, __ATOMIC_RELAXED) & FRESH) {
+		data->front = __atomic_exchange_n(&data->middle, data->front, __ATOMIC_ACQ_REL) & 3;
+	}
+	spectrum* s = &data->spectra[data->front];
+	result->bins = s->bins;
+	result->count = s->count;
+	result->serial = s->serial;
+}
+
+static void publish(analyzer_data* data) {
+	data->back = __atomic_exchange_n(&data->middle, data->back | FRESH, __ATOMIC_ACQ_REL) & 3;
+}
+
+// fill in the window, twiddle factors and bit reversal table for this
+// context, if it's not been done yet
+static void build_tables(nocta_context* context) {
+	struct nocta_tables* tables = get_tables(context);
+	if (tables->fft_window) return;
+
+	tables->fft_window = malloc(FFT_SIZE * sizeof(float));
+	for (int i=0; i<FFT_SIZE; i++) {
+		tables->fft_window[i] = 0.5 - 0.5 * cos(2 * M_PI * i / FFT_SIZE);
+	}
+
+	// butterflies of size 2h use entries h to 2h-1, which also hold the
+	// factors for unpacking a real FFT of size 4h
+	tables->fft_cos = malloc(FFT_SIZE * sizeof(float));
+	tables->fft_sin = malloc(FFT_SIZE * sizeof(float));
+	for (int h=1; h<FFT_SIZE; h*=2) {
+		for (int k=0; k<h; k++) {
+			tables->fft_cos[h+k] = cos(M_PI * k / h);
+			tables->fft_sin[h+k] = -sin(M_PI * k / h);
+		}
+	}
+	tables->fft_cos[0] = tables->fft_sin[0] = 0;
+
+	tables->fft_reverse = malloc(FFT_SIZE / 2 * sizeof(uint16_t));
+	for (int i=0; i<FFT_SIZE/2; i++) {
+		int r = 0;
+		for (int b=0; b<HALF_BITS; b++) r |= ((i >> b) & 1) << (HALF_BITS - 1 - b);
+		tables->fft_reverse[i] = r;
+	}
+}
+
+// one stage's butterflies for a group, where h is a multiple of LANES
+// (the two halves of a group never overlap, which the compiler needs to know)
+static void butterflies(float* restrict ar, float* restrict ai, float* restrict br, float* restrict bi,
+                        const float* restrict wr, const float* restrict wi, int h) {
+	for (int k=0; k<h; k+=LANES) {
+		for (int l=k; l<k+LANES; l++) {
+			float tr = br[l] * wr[l] - bi[l] * wi[l];
+			float ti = br[l] * wi[l] + bi[l] * wr[l];
+			br[l] = ar[l] - tr;
+			bi[l] = ai[l] - ti;
+			ar[l] += tr;
+			ai[l] += ti;
+		}
+	}
+}
+
+// complex FFT of 2^bits points in place, whose inputs are already in bit reversed order
+static void fft(struct nocta_tables* tables, float* re, float* im, int bits) {
+	int n = 1 << bits;
+	for (int h=1; h<n; h*=2) {
+		const float* wr = tables->fft_cos + h;
+		const float* wi = tables->fft_sin + h;
+		for (int j=0; j<n; j+=2*h) {
+			if (h >= LANES) {
+				butterflies(re + j, im + j, re + j + h, im + j + h, wr, wi, h);
+				continue;
+			}
+			// the first stages have fewer butterflies than LANES
+			for (int k=j; k<j+h; k++) {
+				float tr = re[k+h] * wr[k-j] - im[k+h] * wi[k-j];
+				float ti = re[k+h] * wi[k-j] + im[k+h] * wr[k-j];
+				re[k+h] = re[k] - tr;
+				im[k+h] = im[k] - ti;
+				re[k] += tr;
+				im[k] += ti;
+			}
+		}
+	}
+}
+
+// window the latest frame, and work out the magnitudes of its spectrum
+static void analyse(analyzer_data* data) {
+	struct nocta_tables* tables = data->tables;
+	int size = 1 << data->bits;
+	int half = size / 2;
+	int stride = FFT_SIZE / size;    // through the largest window
+	int shift = HALF_BITS - (data->bits - 1);
+	float* re = data->re;
+	float* im = data->im;
+
+	// even samples go in the real parts and odd ones in the imaginary parts,
+	// already in bit reversed order
+	uint32_t start = data->pos - size;
+	for (int i=0; i<half; i++) {
+		int j = tables->fft_reverse[i] >> shift;
+		re[j] = data->history[(start + 2*i) & (FFT_SIZE-1)] * tables->fft_window[2*i * stride];
+		im[j] = data->history[(start + 2*i+1) & (FFT_SIZE-1)] * tables->fft_window[(2*i+1) * stride];
+	}
+	fft(tables, re, im, data->bits - 1);
+
+	// unpack the spectrum of the real frame, where a full scale sine wave
+	// comes to 1.0 (the Hann window halves its amplitude)
+	spectrum* s = &data->spectra[data->back];
+	float scale = 4.0f / size;
+	const float* wr = tables->fft_cos + half;
+	const float* wi = tables->fft_sin + half;
+	s->bins[0] = fabsf(re[0] + im[0]) * scale * 0.5f;
+	s->bins[half] = fabsf(re[0] - im[0]) * scale * 0.5f;
+	for (int k=1; k<half; k++) {
+		float a = re[k], b = im[k];
+		float c = re[half-k], d = im[half-k];
+		float even_r = (a + c) * 0.5f, even_i = (b - d) * 0.5f;
+		float odd_r = (b + d) * 0.5f, odd_i = (c - a) * 0.5f;
+		float xr = even_r + wr[k] * odd_r - wi[k] * odd_i;
+		float xi = even_i + wr[k] * odd_i + wi[k] * odd_r;
+		s->bins[k] = sqrtf(xr * xr + xi * xi) * scale;
+	}
+	s->count = half + 1;
+	s->serial = ++data->serial;
+	publish(data);
+}
+
+// frames the next span can run for before an analysis is due
+static inline int next_span(analyzer_data* data, size_t frames) {
+	// the hop may have been shortened since the countdown started
+	data->countdown = MIN(data->countdown, data->hop);
+	return MIN(frames, (size_t)data->countdown);
+}
+
+// move on `frames` frames, analysing if it's time
+static inline void span_done(analyzer_data* data, int frames) {
+	data->countdown -= frames;
+	if (data->countdown == 0) {
+		analyse(data);
+		data->countdown = data->hop;
+	}
+}
+
+static int analyzer_l(nocta_unit* self, int x) {
+	analyzer_data* data = self->data;
+	data->last_l = x;
+	return x;
+}
+
+static int analyzer_r(nocta_unit* self, int x) {
+	analyzer_data* data = self->data;
+	next_span(data, 1);
+	data->history[data->pos++ & (FFT_SIZE-1)] = (data->last_l + x) * (0.5f / 32768);
+	span_done(data, 1);
+	return x;
+}
+
+static void analyzer_buffer(nocta_unit* self, int16_t* buffer, size_t length) {
+	analyzer_data* data = self->data;
+	size_t frames = length / 2;
+	while (frames > 0) {
+		int n = next_span(data, frames);
+		for (int i=0; i<n; i++) {
+			data->history[(data->pos + i) & (FFT_SIZE-1)] = (buffer[0] + buffer[1]) * (0.5f / 32768);
+			buffer += 2;
+		}
+		data->pos += n;
+		frames -= n;
+		span_done(data, n);
+	}
+}
+
+static void analyzer_float(nocta_unit* self, float* buffer, size_t length) {
+	analyzer_data* data = self->data;
+	size_t frames = length / 2;
+	while (frames > 0) {
+		int n = next_span(data, frames);
+		for (int i=0; i<n; i++) {
+			data->history[(data->pos + i) & (FFT_SIZE-1)] = (buffer[0] + buffer[1]) * 0.5f;
+			buffer += 2;
+		}
+		data->pos += n;
+		frames -= n;
+		span_done(data, n);
+	}
+}
+
+
+// getters and setters:
+
+static int get_size(nocta_unit* self) {
+	analyzer_data* data = self->data;
+	return data->bits;
+}
+static void set_size(nocta_unit* self, int size) {
+	analyzer_data* data = self->data;
+	data->bits = CLAMP(size, MIN_BITS, MAX_BITS);
+}
+
+static int get_hop(nocta_unit* self) {
+	analyzer_data* data = self->data;
+	return data->hop;
+}
+static void set_hop(nocta_unit* self, int hop) {
+	analyzer_data* data = self->data;
+	data->hop = CLAMP(hop, 16, 65536);
+}
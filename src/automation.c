@@ -0,0 +1,274 @@
+#include "common.h"
+
+// Automation lanes.
+// The breakpoints are turned into segments with a precomputed step when the
+// lane is attached, so playing it back is only an add (linear curves) or a
+// multiply (exponential ones) per frame, without any libm calls. Parameters
+// which can be modulated get a whole block of values at once, through their
+// modulation buffer; the others are set at the start of each block, and only
+// when the value has changed, so a flat lane costs almost nothing.
+//
+// nocta_automate never touches the lanes being played: it builds a whole new
+// set, copying the lanes it keeps, and hands it over through
+// unit->pending_automation. The processing thread swaps it in at the start of
+// its next call, carrying over where the kept lanes had got to, and passes
+// the old set back on unit->retired_automation, for nocta_automate (or
+// nocta_free) to free, so neither side ever waits or allocates for the other.
+
+#define EXP_MAX 32767  // largest value an exponential curve can reach
+
+typedef struct {
+	uint32_t time;     // frame where the segment starts
+	int64_t value;     // value at the start, in 48:16
+	int64_t step;      // added each frame (48:16), or for exponential curves,
+	                   // the ratio each frame (2:30) minus 1.0
+	int curve;
+} lane_segment;
+
+typedef struct {
+	int param_id;
+	bool modulated;        // whether values go to the parameter's modulation buffer
+	uint32_t serial;       // set when the lane was attached, and kept by copies of it
+	lane_segment* segments;
+	int num_segments;
+
+	// playback:
+	int seg;               // current segment
+	uint32_t time;         // frames since the lane started
+	int64_t value;         // in 48:16
+	int last;              // last value set (for parameters which aren't modulated)
+	int values[AUTOMATION_FRAMES];
+} automation_lane;
+
+struct nocta_automation {
+	uint32_t serial;       // of the newest lane in the set
+	struct nocta_automation* next;  // in the retired list
+	int count;
+	automation_lane lanes[];
+};
+
+static void set_free(struct nocta_automation* a) {
+	for (int i=0; i<a->count; i++) free(a->lanes[i].segments);
+	free(a);
+}
+
+// free the sets the processing thread has finished with
+static void free_retired(nocta_unit* unit) {
+	struct nocta_automation* a = __atomic_exchange_n(&unit->retired_automation, NULL, __ATOMIC_ACQUIRE);
+	while (a) {
+		struct nocta_automation* next = a->next;
+		// (an empty set is retired as soon as it's taken)
+		if (a == unit->latest_automation) unit->latest_automation = NULL;
+		set_free(a);
+		a = next;
+	}
+}
+
+void automation_free(nocta_unit* unit) {
+	free_retired(unit);
+	if (unit->pending_automation) set_free(unit->pending_automation);
+	if (unit->automation) set_free(unit->automation);
+	unit->pending_automation = unit->automation = unit->latest_automation = NULL;
+}
+
+// work out how each segment gets to the next breakpoint
+static lane_segment* make_segments(const nocta_breakpoint* points, int count) {
+	lane_segment* segments = malloc(count * sizeof(lane_segment));
+	for (int i=0; i<count; i++) {
+		lane_segment* s = &segments[i];
+		s->time = points[i].time;
+		s->value = (int64_t)points[i].value << 16;
+		s->step = 0;
+		s->curve = points[i].curve;
+		if (i == count-1 || s->curve == NOCTA_CURVE_HOLD) {
+			s->curve = NOCTA_CURVE_HOLD;
+			continue;
+		}
+
+		int64_t from = points[i].value, to = points[i+1].value;
+		uint32_t frames = points[i+1].time - points[i].time;
+		double ratio = 0; // each frame, for exponential curves
+		if (s->curve == NOCTA_CURVE_EXPONENTIAL && from > 0 && to > 0 && from <= EXP_MAX && to <= EXP_MAX && frames)
+			ratio = pow((double)to / from, 1.0 / frames);
+
+		if (frames == 0) {
+			s->curve = NOCTA_CURVE_HOLD;
+		} else if (ratio > 0 && ratio < 2) {
+			s->step = llround((ratio - 1) * (1 << 30));
+		} else {
+			// (doubling in a single frame is a jump anyway)
+			s->curve = NOCTA_CURVE_LINEAR;
+			s->step = ((to - from) << 16) / frames;
+		}
+	}
+	return segments;
+}
+
+bool nocta_automate(nocta_unit* unit, int param_id, const nocta_breakpoint* points, int count) {
+	if (param_id < 0 || param_id >= unit->num_params)
+		return false;
+	for (int i=1; i<count; i++) {
+		if (points[i].time < points[i-1].time)
+			return false;
+	}
+	free_retired(unit);
+
+	// copy the newest set, apart from the lane that's being replaced
+	// (only the parts that never change once a lane is attached are read,
+	// as the processing thread may be playing it)
+	struct nocta_automation* latest = unit->latest_automation;
+	int kept = latest ? latest->count : 0;
+	struct nocta_automation* a = malloc(sizeof(struct nocta_automation) + (kept + 1) * sizeof(automation_lane));
+	a->serial = (latest ? latest->serial : 0) + 1;
+	a->next = NULL;
+	a->count = 0;
+	for (int i=0; i<kept; i++) {
+		const automation_lane* from = &latest->lanes[i];
+		if (from->param_id == param_id)
+			continue;
+		automation_lane* lane = &a->lanes[a->count++];
+		*lane = (automation_lane){
+			.param_id = from->param_id,
+			.modulated = from->modulated,
+			.serial = from->serial,
+			.segments = malloc(from->num_segments * sizeof(lane_segment)),
+			.num_segments = from->num_segments,
+			.value = from->segments[0].value,
+			.last = INT32_MIN
+		};
+		memcpy(lane->segments, from->segments, from->num_segments * sizeof(lane_segment));
+	}
+
+	if (count > 0) {
+		a->lanes[a->count++] = (automation_lane){
+			.param_id = param_id,
+			.modulated = unit->params[param_id].modulate != NULL,
+			.serial = a->serial,
+			.segments = make_segments(points, count),
+			.num_segments = count,
+			.value = (int64_t)points[0].value << 16,
+			.last = INT32_MIN
+		};
+	}
+
+	// a set that was never taken can go straight away
+	struct nocta_automation* old = __atomic_exchange_n(&unit->pending_automation, a, __ATOMIC_ACQ_REL);
+	if (old) set_free(old);
+	unit->latest_automation = a;
+	return true;
+}
+
+static automation_lane* find_lane(struct nocta_automation* a, int param_id) {
+	for (int i=0; a && i<a->count; i++) {
+		if (a->lanes[i].param_id == param_id)
+			return &a->lanes[i];
+	}
+	return NULL;
+}
+
+// hand a set back to be freed, off the processing thread
+static void retire(nocta_unit* unit, struct nocta_automation* a) {
+	a->next = __atomic_load_n(&unit->retired_automation, __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(&unit->retired_automation, &a->next, a,
+		true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+void update_automation(nocta_unit* unit) {
+	if (!__atomic_load_n(&unit->pending_automation, __ATOMIC_RELAXED))
+		return;
+	struct nocta_automation* a = __atomic_exchange_n(&unit->pending_automation, NULL, __ATOMIC_ACQUIRE);
+	if (!a)
+		return;
+	struct nocta_automation* old = unit->automation;
+
+	for (int i=0; i<a->count; i++) {
+		automation_lane* lane = &a->lanes[i];
+		automation_lane* prev = find_lane(old, lane->param_id);
+		if (prev && prev->serial == lane->serial) {
+			// the same lane, so carry on from where it was
+			lane->seg = prev->seg;
+			lane->time = prev->time;
+			lane->value = prev->value;
+			lane->last = prev->last;
+		}
+		if (lane->modulated) unit->params[lane->param_id].modulate(unit, lane->values);
+	}
+	for (int i=0; old && i<old->count; i++) {
+		automation_lane* lane = &old->lanes[i];
+		if (lane->modulated && !find_lane(a, lane->param_id))
+			unit->params[lane->param_id].modulate(unit, NULL);
+	}
+
+	unit->automation = a->count ? a : NULL;
+	if (old) retire(unit, old);
+	if (!a->count) retire(unit, a);
+}
+
+// move on to any segments which have started
+static void lane_catch_up(automation_lane* lane) {
+	while (lane->seg + 1 < lane->num_segments && lane->time >= lane->segments[lane->seg+1].time) {
+		lane->seg++;
+		lane->value = lane->segments[lane->seg].value;
+	}
+}
+
+// move a lane along `frames` frames, storing its values if `out` isn't NULL
+static void lane_run(automation_lane* lane, int* out, size_t frames) {
+	size_t f = 0;
+	while (f < frames) {
+		lane_catch_up(lane);
+		lane_segment* s = &lane->segments[lane->seg];
+
+		// frames until the curve changes
+		size_t n = frames - f;
+		if (lane->time < s->time) {
+			n = MIN(n, s->time - lane->time); // before the first breakpoint
+		} else if (lane->seg + 1 < lane->num_segments) {
+			n = MIN(n, lane->segments[lane->seg+1].time - lane->time);
+		}
+
+		int64_t value = lane->value;
+		if (lane->time < s->time || s->curve == NOCTA_CURVE_HOLD) {
+			if (out) {
+				int v = (value + 0x8000) >> 16;
+				for (size_t i=0; i<n; i++) out[f+i] = v;
+			}
+		} else if (s->curve == NOCTA_CURVE_LINEAR) {
+			if (out) {
+				for (size_t i=0; i<n; i++) {
+					out[f+i] = (value + 0x8000) >> 16;
+					value += s->step;
+				}
+			} else {
+				value += s->step * (int64_t)n;
+			}
+		} else {
+			for (size_t i=0; i<n; i++) {
+				if (out) out[f+i] = (value + 0x8000) >> 16;
+				value += value * s->step >> 30;
+			}
+		}
+		lane->value = value;
+		lane->time += n;
+		f += n;
+	}
+}
+
+void run_automation(nocta_unit* unit, size_t frames) {
+	struct nocta_automation* a = unit->automation;
+	for (int i=0; i<a->count; i++) {
+		automation_lane* lane = &a->lanes[i];
+		if (lane->modulated) {
+			lane_run(lane, lane->values, frames);
+			continue;
+		}
+		// set the value at the start of the block, if it's changed
+		lane_catch_up(lane);
+		int value = (lane->value + 0x8000) >> 16;
+		if (value != lane->last) {
+			nocta_set(unit, lane->param_id, value);
+			lane->last = value;
+		}
+		lane_run(lane, NULL, frames);
+	}
+}
@@ -0,0 +1,148 @@
+#include "common.h"
+#include "bank.h"
+#include <stdio.h>
+
+// Sample banks.
+// The file is mapped into memory read-only, so pages are only loaded when
+// something plays them, and any number of samplers can share the mapping.
+// Where mmap isn't available, the file is read into memory instead.
+// Samples are little-endian, as in WAV files.
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define HAVE_MMAP
+#endif
+
+static bool load_file(nocta_bank* bank, const char* path) {
+#ifdef HAVE_MMAP
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat st;
+	if (fstat(fd, &st) < 0 || st.st_size == 0) {
+		close(fd);
+		return false;
+	}
+	void* memory = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd); // the mapping keeps the file open
+	if (memory == MAP_FAILED)
+		return false;
+	bank->memory = memory;
+	bank->size = st.st_size;
+	bank->mapped = true;
+	return true;
+#else
+	FILE* f = fopen(path, "rb");
+	if (!f)
+		return false;
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	void* memory = size > 0 ? malloc(size) : NULL;
+	if (!memory || fread(memory, 1, size, f) != (size_t)size) {
+		free(memory);
+		fclose(f);
+		return false;
+	}
+	fclose(f);
+	bank->memory = memory;
+	bank->size = size;
+	bank->mapped = false;
+	return true;
+#endif
+}
+
+static uint32_t read_u32(const uint8_t* p) {
+	return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+static uint16_t read_u16(const uint8_t* p) {
+	return p[0] | p[1] << 8;
+}
+
+// find the samples in a WAV file, which must be 16-bit mono
+static bool parse_wav(nocta_bank* bank) {
+	const uint8_t* file = bank->memory;
+	size_t pos = 12;
+	bool format_ok = false;
+	while (pos + 8 <= bank->size) {
+		const uint8_t* chunk = file + pos;
+		uint32_t size = read_u32(chunk + 4);
+		size_t body = pos + 8;
+		if (memcmp(chunk, "fmt ", 4) == 0 && size >= 16 && body + 16 <= bank->size) {
+			format_ok = read_u16(chunk + 8) == 1      // PCM
+			         && read_u16(chunk + 10) == 1     // mono
+			         && read_u16(chunk + 22) == 16;   // 16 bits
+			bank->sample_rate = read_u32(chunk + 12);
+		} else if (memcmp(chunk, "data", 4) == 0) {
+			if (!format_ok || body % 2)
+				return false;
+			size = MIN(size, bank->size - body);
+			bank->samples = (const int16_t*)(file + body);
+			bank->length = size / 2;
+			return true;
+		}
+		pos = body + size + (size & 1); // chunks are padded to an even size
+	}
+	return false;
+}
+
+nocta_bank* nocta_bank_open(const char* path, int sample_rate) {
+	nocta_bank* bank = ialloc(nocta_bank, .sample_rate = sample_rate);
+	if (!load_file(bank, path)) {
+		free(bank);
+		return NULL;
+	}
+
+	const uint8_t* file = bank->memory;
+	bool ok = true;
+	if (bank->size >= 12 && memcmp(file, "RIFF", 4) == 0 && memcmp(file + 8, "WAVE", 4) == 0) {
+		ok = parse_wav(bank);
+	} else {
+		bank->samples = bank->memory;
+		bank->length = bank->size / 2;
+	}
+	if (!ok || bank->length == 0 || bank->sample_rate <= 0) {
+		nocta_bank_close(bank);
+		return NULL;
+	}
+
+#ifdef HAVE_MMAP
+	// voices jump around the bank, so don't read far ahead of them
+	madvise(bank->memory, bank->size, MADV_RANDOM);
+#endif
+	return bank;
+}
+
+void nocta_bank_close(nocta_bank* bank) {
+#ifdef HAVE_MMAP
+	if (bank->mapped) {
+		munmap(bank->memory, bank->size);
+		free(bank);
+		return;
+	}
+#endif
+	free(bank->memory);
+	free(bank);
+}
+
+uint32_t nocta_bank_length(nocta_bank* bank) {
+	return bank->length;
+}
+
+void nocta_bank_prefetch(nocta_bank* bank, uint32_t start, uint32_t length) {
+#ifdef HAVE_MMAP
+	if (!bank->mapped || start >= bank->length)
+		return;
+	length = MIN(length, bank->length - start);
+
+	// madvise wants a page aligned address
+	size_t page = sysconf(_SC_PAGESIZE);
+	uintptr_t begin = (uintptr_t)(bank->samples + start);
+	uintptr_t end = (uintptr_t)(bank->samples + start + length);
+	begin &= ~(uintptr_t)(page - 1);
+	madvise((void*)begin, end - begin, MADV_WILLNEED);
+#endif
+}
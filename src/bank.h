@@ -0,0 +1,14 @@
+#pragma once
+#include "common.h"
+
+// A block of 16-bit mono samples, mapped from a file (see bank.c)
+
+struct nocta_bank {
+	const int16_t* samples;
+	uint32_t length;     // in samples
+	int sample_rate;
+
+	void* memory;        // the whole file
+	size_t size;
+	bool mapped;         // whether `memory` is mapped, rather than allocated
+};
@@ -1,4 +1,5 @@
 #include "common.h"
+#include "tables.h"
 
 // Biquad filter, based on the algorithm presented in
 // the Audio EQ Cookbook by Robert Bristow-Johnson.
@@ -13,11 +14,12 @@ static void set_vol(nocta_unit* self, int vol);
 static void set_mode(nocta_unit* self, int mode);
 static void set_freq(nocta_unit* self, int freq);
 static void set_res(nocta_unit* self, int res);
+static void modulate_freq(nocta_unit* self, const int* values);
 
 static nocta_param bqfilter_params[] = {
 	{"volume", 0, 255, get_vol, set_vol},
 	{"mode", 0, NOCTA_FILTER_NUM_MODES-1, get_mode, set_mode},
-	{"frequency", 100, 22050, get_freq, set_freq},
+	{"frequency", 100, 22050, get_freq, set_freq, modulate_freq},
 	{"resoncance", 0, 255, get_res, set_res}
 };
 
@@ -28,72 +30,140 @@ typedef struct {
 	int out1, out2; // values of the previous 2 output samples
 } filter_state;
 
+typedef struct {
+	float in1, in2, out1, out2;
+} float_state;
+
+// everything that depends on the frequency
+typedef struct {
+	int amp;
+	int a1, a2;
+	int b0, b1, b2;
+	bq_coefs_f f;  // the same, for the float backend
+} filter_coefs;
+
 typedef struct {
 	// properties:
 	uint8_t vol;
 	int mode;
 	int freq;
-	int amp;
 	uint8_t res;
 	
-	// coefficients:
-	int a0, a1, a2;
-	int b0, b1, b2;
+	filter_coefs coefs;
 	
+	// state (everything above is captured by presets):
 	filter_state l[NUM_PASSES], r[NUM_PASSES];
+	float_state fl[NUM_PASSES], fr[NUM_PASSES];
+	const int* mod_freq;
+	filter_coefs mod_coefs;  // for the current frame, when modulated
+	int gain;                // 16:16, folded in from gainers by a graph
 } filter_data;
 
+// a modulated frequency only updates the coefficients every this many frames
+#define MOD_STEP 8
+
 // calculate the coefficients when frequency, resonance, etc are changed
+static void build_table(nocta_context* context);
+static void lookup_coefficients(nocta_unit* self, int freq, filter_coefs* c);
 static void update_coefficients(nocta_unit* self);
 
 // get the next sample
-static int bqfilter_run(filter_data* data, filter_state* state, int input);
+static int bqfilter_run(filter_coefs* c, filter_state* state, int input);
 static int bqfilter_l(nocta_unit* self, int x);
 static int bqfilter_r(nocta_unit* self, int x);
+static void bqfilter_buffer(nocta_unit* self, int16_t* buffer, size_t length);
+static void bqfilter_float(nocta_unit* self, float* buffer, size_t length);
 
 nocta_unit* nocta_bqfilter(nocta_context* context) {
 	
+	build_table(context);
+	
 	nocta_unit* self = nocta_create(
 		.context = context,
 		.name = "bqfilter",
 		.data = ialloc(filter_data,
 			.vol = 255,
 			.freq = 22050,
-			.res = 0
+			.res = 0,
+			.gain = 65536
 		),
 		.process_l = bqfilter_l,
 		.process_r = bqfilter_r,
+		.process_buffer = bqfilter_buffer,
+		.process_float = bqfilter_float,
 		.params = bqfilter_params,
-		.num_params = NOCTA_FILTER_NUM_PARAMS
+		.num_params = NOCTA_FILTER_NUM_PARAMS,
+		.preset_size = offsetof(filter_data, l)
 	);
 	
 	set_mode(self, NOCTA_FILTER_MODE_LOWPASS);
+	preset_snapshot(self);
 	return self;
 }
 
+static inline int modulated_freq(const int* mod, size_t i) {
+	return CLAMP(mod[i], 100, 22050);
+}
+
+// output volume (16:16), with any gain folded in at full precision, so a
+// quiet fused run isn't rounded to a whole step of the 8-bit volume
+static inline int out_vol(filter_data* data) {
+	return (int64_t)data->vol * data->gain >> 8;
+}
+
+static inline int bqfilter_frame(filter_coefs* c, filter_state* state, int x, int vol) {
+	x = x*c->amp >> 8;
+	for (int i=0; i<NUM_PASSES; i++) {
+		x = bqfilter_run(c, &state[i], x);
+	}
+	return (int64_t)x * vol >> 16;
+}
+
+// the left channel looks up modulated coefficients for both channels
 static int bqfilter_l(nocta_unit* self, int x) {
 	filter_data* data = self->data;
-	x = x*data->amp >> 8;
-	for (int i=0; i<NUM_PASSES; i++) {
-		x = bqfilter_run(data, &data->l[i], x);
+	filter_coefs* c = &data->coefs;
+	if (data->mod_freq) {
+		c = &data->mod_coefs;
+		lookup_coefficients(self, modulated_freq(data->mod_freq, self->block_pos), c);
 	}
-	return x*data->vol >> 8;
+	return bqfilter_frame(c, data->l, x, out_vol(data));
 }
 static int bqfilter_r(nocta_unit* self, int x) {
 	filter_data* data = self->data;
-	x = x*data->amp >> 8;
-	for (int i=0; i<NUM_PASSES; i++) {
-		x = bqfilter_run(data, &data->r[i], x);
+	return bqfilter_frame(data->mod_freq ? &data->mod_coefs : &data->coefs, data->r, x, out_vol(data));
+}
+
+static int bqfilter_run(filter_coefs* c, filter_state* state, int input) {
+	int output = fix_mul(c->b0, input);
+	output += fix_mul(c->b1, state->in1);
+	output += fix_mul(c->b2, state->in2);
+	output -= fix_mul(c->a1, state->out1);
+	output -= fix_mul(c->a2, state->out2);
+	state->in2 = state->in1;
+	state->in1 = input;
+	state->out2 = state->out1;
+	state->out1 = output;
+	return output;
+}
+
+static void bqfilter_buffer(nocta_unit* self, int16_t* buffer, size_t length) {
+	filter_data* data = self->data;
+	const int* mod = data->mod_freq ? data->mod_freq + self->block_pos : NULL;
+	filter_coefs c = data->coefs;
+	int vol = out_vol(data);
+	for (size_t i=0; i<length/2; i++) {
+		if (mod && i % MOD_STEP == 0)
+			lookup_coefficients(self, modulated_freq(mod, i), &c);
+		buffer[0] = clip(bqfilter_frame(&c, data->l, buffer[0], vol));
+		buffer[1] = clip(bqfilter_frame(&c, data->r, buffer[1], vol));
+		buffer += 2;
 	}
-	return x*data->vol >> 8;
 }
 
-static int bqfilter_run(filter_data* data, filter_state* state, int input) {
-	int output = fix_mul(data->b0, input);
-	output += fix_mul(data->b1, state->in1);
-	output += fix_mul(data->b2, state->in2);
-	output -= fix_mul(data->a1, state->out1);
-	output -= fix_mul(data->a2, state->out2);
+static inline float bqfilter_run_float(bq_coefs_f* c, float_state* state, float input) {
+	float output = c->b0 * input + c->b1 * state->in1 + c->b2 * state->in2
+	             - c->a1 * state->out1 - c->a2 * state->out2;
 	state->in2 = state->in1;
 	state->in1 = input;
 	state->out2 = state->out1;
@@ -101,61 +171,180 @@ static int bqfilter_run(filter_data* data, filter_state* state, int input) {
 	return output;
 }
 
-static void update_coefficients(nocta_unit* self) {
+// both channels are run side by side, so their recursions can overlap
+static void bqfilter_float(nocta_unit* self, float* buffer, size_t length) {
 	filter_data* data = self->data;
+	const int* mod = data->mod_freq ? data->mod_freq + self->block_pos : NULL;
+	filter_coefs c = data->coefs;
+	float amp = c.amp / 256.0f;
+	float vol = data->vol / 256.0f * (data->gain / 65536.0f);
+	for (size_t i=0; i<length; i+=2) {
+		if (mod && i/2 % MOD_STEP == 0) {
+			lookup_coefficients(self, modulated_freq(mod, i/2), &c);
+			amp = c.amp / 256.0f;
+		}
+		float l = buffer[i] * amp;
+		float r = buffer[i+1] * amp;
+		for (int p=0; p<NUM_PASSES; p++) {
+			l = bqfilter_run_float(&c.f, &data->fl[p], l);
+			r = bqfilter_run_float(&c.f, &data->fr[p], r);
+		}
+		buffer[i] = l * vol;
+		buffer[i+1] = r * vol;
+	}
+}
+
+static void modulate_freq(nocta_unit* self, const int* values) {
+	filter_data* data = self->data;
+	data->mod_freq = values;
+}
+
+void bqfilter_fold(nocta_unit* self, int gain) {
+	filter_data* data = self->data;
+	data->gain = gain;
+}
+
+typedef struct {
+	double b0, b1, b2, a1, a2;
+} exact_coefs;
+
+// calculate the exact coefficients for one filter setting
+static exact_coefs calc_coefficients(int mode, double freq, int res, int sample_rate) {
+	double w0 = 2 * M_PI * MIN(freq, sample_rate / 2) / sample_rate;
+	double cos_w0 = cos(w0);
+	double sin_w0 = sin(w0);
+	double alpha = sin_w0 / (2.0 * res / 256 + 0.1);
+	double b0, b1, b2;
+	double a0 = 1 + alpha;
+	double a1 = -2 * cos_w0;
+	double a2 = 1 - alpha;
 	
-	int sample_rate = self->context->sample_rate;
-	int w0 = (2 * FIX_PI * data->freq) / sample_rate;
-	int cos_w0 = fix_cos(w0);
-	int sin_w0 = fix_sin(w0);
-	int res = 2*u8_to_fix(data->res) + FIX_1/10;
-	int alpha = fix_div(sin_w0, res);
-	
-	switch (data->mode) {
+	switch (mode) {
 		case NOCTA_FILTER_MODE_LOWPASS:
-			data->amp = 200;
-			data->b0 = (FIX_1 - cos_w0) / 2;
-			data->b1 = FIX_1 - cos_w0;
-			data->b2 = (FIX_1 - cos_w0) / 2;
-			data->a0 = FIX_1 + alpha;
-			data->a1 = -2 * cos_w0;
-			data->a2 = FIX_1 - alpha;
+			b0 = (1 - cos_w0) / 2;
+			b1 = 1 - cos_w0;
+			b2 = (1 - cos_w0) / 2;
 			break;
 		case NOCTA_FILTER_MODE_HIGHPASS:
-			data->amp = 200 + (data->freq >> 5);
-			data->b0 = (FIX_1 + cos_w0) / 2;
-			data->b1 = -(FIX_1 + cos_w0);
-			data->b2 = (FIX_1 + cos_w0) / 2;
-			data->a0 = FIX_1 + alpha;
-			data->a1 = -2 * cos_w0;
-			data->a2 = FIX_1 - alpha;
+			b0 = (1 + cos_w0) / 2;
+			b1 = -(1 + cos_w0);
+			b2 = (1 + cos_w0) / 2;
 			break;
 		case NOCTA_FILTER_MODE_BANDPASS:
-			data->amp = 255 + (data->freq >> 5);
-			data->b0 = sin_w0/2;
-			data->b1 = 0;
-			data->b2 = -sin_w0/2;
-			data->a0 = FIX_1 + alpha;
-			data->a1 = -2 * cos_w0;
-			data->a2 = FIX_1 - alpha;
+			b0 = sin_w0 / 2;
+			b1 = 0;
+			b2 = -sin_w0 / 2;
 			break;
-		case NOCTA_FILTER_MODE_NOTCH:
-			data->amp = 200;
-			data->b0 = FIX_1;
-			data->b1 = -2 * cos_w0;
-			data->b2 = FIX_1;
-			data->a0 = FIX_1 + alpha;
-			data->a1 = -2 * cos_w0;
-			data->a2 = FIX_1 - alpha;
+		default: // NOCTA_FILTER_MODE_NOTCH
+			b0 = 1;
+			b1 = -2 * cos_w0;
+			b2 = 1;
 			break;
 	}
 	
 	// optimisation: divide the coefficients in advance, so it doesn't need to be done per-sample
-	data->b0 = fix_div(data->b0, data->a0);
-	data->b1 = fix_div(data->b1, data->a0);
-	data->b2 = fix_div(data->b2, data->a0);
-	data->a1 = fix_div(data->a1, data->a0);
-	data->a2 = fix_div(data->a2, data->a0);
+	return (exact_coefs){ b0 / a0, b1 / a0, b2 / a0, a1 / a0, a2 / a0 };
+}
+
+// fill in the coefficient table for this context's backend, if it's not been done yet
+// (3:13 coefficients are too coarse for a float filter at low frequencies,
+// so the float backend gets its own table)
+static void build_table(nocta_context* context) {
+	struct nocta_tables* tables = get_tables(context);
+	bool use_float = context->backend == NOCTA_BACKEND_FLOAT;
+	if (use_float ? tables->bqfilter_f != NULL : tables->bqfilter != NULL) return;
+	
+	if (use_float)
+		tables->bqfilter_f = malloc(NOCTA_FILTER_NUM_MODES * sizeof(*tables->bqfilter_f));
+	else
+		tables->bqfilter = malloc(NOCTA_FILTER_NUM_MODES * sizeof(*tables->bqfilter));
+	
+	for (int mode=0; mode<NOCTA_FILTER_NUM_MODES; mode++) {
+		for (int r=0; r<BQ_RES_STEPS; r++) {
+			for (int i=0; i<BQ_FREQ_STEPS; i++) {
+				int octave = BQ_MIN_OCTAVE + i / BQ_STEPS_PER_OCTAVE;
+				int step = i % BQ_STEPS_PER_OCTAVE;
+				double freq = (1 << octave) * (1 + (double)step / BQ_STEPS_PER_OCTAVE);
+				exact_coefs c = calc_coefficients(mode, freq, r*32, context->sample_rate);
+				if (use_float) {
+					tables->bqfilter_f[mode][r][i] = (bq_coefs_f){ c.b0, c.b1, c.b2, c.a1, c.a2 };
+				} else {
+					tables->bqfilter[mode][r][i] = (bq_coefs){
+						c.b0 * FIX_1, c.b1 * FIX_1, c.b2 * FIX_1, c.a1 * FIX_1, c.a2 * FIX_1
+					};
+				}
+			}
+		}
+	}
+}
+
+#define LERP(a,b,t) ((a) + (((b)-(a)) * (t) >> 8))
+
+// look up the coefficients for a frequency
+static void lookup_coefficients(nocta_unit* self, int freq, filter_coefs* c) {
+	filter_data* data = self->data;
+	int amp_freq = freq;
+	
+	// position in the table, in 1/256ths of a step
+	freq = CLAMP(freq, 1 << BQ_MIN_OCTAVE, (1 << BQ_MAX_OCTAVE) - 1);
+	int octave = 31 - __builtin_clz(freq);
+	int frac = (freq << 8 >> octave) - 256; // how far through the octave, 0..255
+	int f = ((octave - BQ_MIN_OCTAVE) * 256 + frac) * BQ_STEPS_PER_OCTAVE;
+	int r = data->res * 8;
+	int fi = f >> 8, ft = f & 0xff;
+	int ri = r >> 8, rt = r & 0xff;
+	
+	if (self->context->backend == NOCTA_BACKEND_FLOAT) {
+		bq_coefs_f (*table)[BQ_FREQ_STEPS] = self->context->tables->bqfilter_f[data->mode];
+		bq_coefs_f* c00 = &table[ri][fi];
+		bq_coefs_f* c01 = &table[ri][fi+1];
+		bq_coefs_f* c10 = &table[ri+1][fi];
+		bq_coefs_f* c11 = &table[ri+1][fi+1];
+		float ftf = ft / 256.0f, rtf = rt / 256.0f;
+		
+		#define LERPF(a,b,t) ((a) + ((b)-(a)) * (t))
+		#define BILERP(k) LERPF(LERPF(c00->k, c01->k, ftf), LERPF(c10->k, c11->k, ftf), rtf)
+		c->f.b0 = BILERP(b0);
+		c->f.b1 = BILERP(b1);
+		c->f.b2 = BILERP(b2);
+		c->f.a1 = BILERP(a1);
+		c->f.a2 = BILERP(a2);
+		#undef BILERP
+		#undef LERPF
+	} else {
+		bq_coefs (*table)[BQ_FREQ_STEPS] = self->context->tables->bqfilter[data->mode];
+		bq_coefs* c00 = &table[ri][fi];
+		bq_coefs* c01 = &table[ri][fi+1];
+		bq_coefs* c10 = &table[ri+1][fi];
+		bq_coefs* c11 = &table[ri+1][fi+1];
+		
+		#define BILERP(k) LERP(LERP(c00->k, c01->k, ft), LERP(c10->k, c11->k, ft), rt)
+		c->b0 = BILERP(b0);
+		c->b1 = BILERP(b1);
+		c->b2 = BILERP(b2);
+		c->a1 = BILERP(a1);
+		c->a2 = BILERP(a2);
+		#undef BILERP
+	}
+	
+	switch (data->mode) {
+		case NOCTA_FILTER_MODE_LOWPASS:
+		case NOCTA_FILTER_MODE_NOTCH:
+			c->amp = 200;
+			break;
+		case NOCTA_FILTER_MODE_HIGHPASS:
+			c->amp = 200 + (amp_freq >> 5);
+			break;
+		case NOCTA_FILTER_MODE_BANDPASS:
+			c->amp = 255 + (amp_freq >> 5);
+			break;
+	}
+}
+
+// look up the coefficients when frequency, resonance, etc are changed
+static void update_coefficients(nocta_unit* self) {
+	filter_data* data = self->data;
+	lookup_coefficients(self, data->freq, &data->coefs);
 }
 
 // getters and setters:
@@ -175,7 +364,8 @@ static int get_mode(nocta_unit* self) {
 }
 static void set_mode(nocta_unit* self, int mode) {
 	filter_data* data = self->data;
-	data->mode = mode;
+	// it indexes the coefficient tables, and nocta_set doesn't clamp
+	data->mode = CLAMP(mode, 0, NOCTA_FILTER_NUM_MODES-1);
 	update_coefficients(self);
 }
 
@@ -0,0 +1,229 @@
+#include "common.h"
+#include "delayline.h"
+
+// Modulated delay, used for chorus, flanger and vibrato.
+// A triangle LFO sweeps a fractional delay time. When processing a block,
+// the LFO is only evaluated at the block edges and the delay time is
+// interpolated linearly in between.
+
+// max delay time in tenths of a millisecond:
+#define MAX_DELAY 500
+
+static int get_dry(nocta_unit* self);
+static void set_dry(nocta_unit* self, int dry);
+static int get_wet(nocta_unit* self);
+static void set_wet(nocta_unit* self, int wet);
+static int get_feedback(nocta_unit* self);
+static void set_feedback(nocta_unit* self, int feedback);
+static int get_delay(nocta_unit* self);
+static void set_delay(nocta_unit* self, int delay);
+static int get_depth(nocta_unit* self);
+static void set_depth(nocta_unit* self, int depth);
+static int get_rate(nocta_unit* self);
+static void set_rate(nocta_unit* self, int rate);
+
+static nocta_param chorus_params[] = {
+	{"dry", 0, 255, get_dry, set_dry},
+	{"wet", 0, 255, get_wet, set_wet},
+	{"feedback", 0, 255, get_feedback, set_feedback},
+	{"delay", 1, MAX_DELAY, get_delay, set_delay},
+	{"depth", 0, 255, get_depth, set_depth},
+	{"rate", 1, 1000, get_rate, set_rate}
+};
+
+typedef struct {
+	delay_line line;
+	uint32_t phase;  // LFO phase
+	int current;     // delay in samples (24:8) at the current position
+} chorus_channel;
+
+typedef struct {
+	// parameters and derived values (captured by presets):
+	uint8_t dry, wet;
+	uint8_t feedback;
+	int delay;        // centre delay time
+	uint8_t depth;
+	int rate;
+	int base;         // centre delay in samples (24:8)
+	uint32_t phase_inc;
+	int sample_rate;
+	
+	// state:
+	chorus_channel l, r;
+} chorus_data;
+
+static inline int lfo_delay(chorus_data* data, uint32_t phase);
+static inline int chorus_run(chorus_data* data, chorus_channel* c, int in, int delay);
+static int chorus_l(nocta_unit* self, int x);
+static int chorus_r(nocta_unit* self, int x);
+static void chorus_buffer(nocta_unit* self, int16_t* buffer, size_t length);
+static void chorus_free(nocta_unit* self);
+
+static nocta_unit* chorus_create(nocta_context* context, char* name,
+                                 int dry, int wet, int feedback,
+                                 int delay, int depth, int rate) {
+
+	int length = MAX_DELAY * 2 * context->sample_rate / 10000 + 2;
+
+	chorus_data* data = ialloc(chorus_data,
+		.l = { delay_line_create(length), 0 },
+		.r = { delay_line_create(length), 0x40000000 }, // 90 degrees apart
+		.sample_rate = context->sample_rate
+	);
+
+	nocta_unit* self = nocta_create(
+		.context = context,
+		.name = name,
+		.data = data,
+		.process_l = chorus_l,
+		.process_r = chorus_r,
+		.process_buffer = chorus_buffer,
+		.free = chorus_free,
+		.preset_size = offsetof(chorus_data, l),
+		.params = chorus_params,
+		.num_params = NOCTA_CHORUS_NUM_PARAMS
+	);
+
+	set_dry(self, dry);
+	set_wet(self, wet);
+	set_feedback(self, feedback);
+	set_delay(self, delay);
+	set_depth(self, depth);
+	set_rate(self, rate);
+	data->l.current = lfo_delay(data, data->l.phase);
+	data->r.current = lfo_delay(data, data->r.phase);
+	preset_snapshot(self);
+	return self;
+}
+
+nocta_unit* nocta_chorus(nocta_context* context) {
+	return chorus_create(context, "chorus", 255, 180, 0, 200, 80, 80);
+}
+
+nocta_unit* nocta_flanger(nocta_context* context) {
+	return chorus_create(context, "flanger", 255, 200, 160, 25, 220, 25);
+}
+
+nocta_unit* nocta_vibrato(nocta_context* context) {
+	return chorus_create(context, "vibrato", 0, 255, 0, 50, 200, 500);
+}
+
+static void chorus_free(nocta_unit* self) {
+	chorus_data* data = self->data;
+	delay_line_free(&data->l.line);
+	delay_line_free(&data->r.line);
+}
+
+// delay time (24:8 samples) for a given LFO phase
+static inline int lfo_delay(chorus_data* data, uint32_t phase) {
+	int tri = abs((int)(phase >> 15) - 65536) - 32768; // -32768..32768
+	int range = data->base * data->depth >> 8;
+	int delay = data->base + ((int64_t)range * tri >> 15);
+	return MAX(delay, 256);
+}
+
+static inline int chorus_run(chorus_data* data, chorus_channel* c, int in, int delay) {
+	int out = delay_line_read(&c->line, delay);
+	delay_line_write(&c->line, clip(in + (out * data->feedback >> 8)));
+	return (in * data->dry >> 8)
+	     + (out * data->wet >> 8);
+}
+
+static int chorus_l(nocta_unit* self, int x) {
+	chorus_data* data = self->data;
+	chorus_channel* c = &data->l;
+	c->current = lfo_delay(data, c->phase);
+	c->phase += data->phase_inc;
+	return chorus_run(data, c, x, c->current);
+}
+
+static int chorus_r(nocta_unit* self, int x) {
+	chorus_data* data = self->data;
+	chorus_channel* c = &data->r;
+	c->current = lfo_delay(data, c->phase);
+	c->phase += data->phase_inc;
+	return chorus_run(data, c, x, c->current);
+}
+
+static void chorus_buffer(nocta_unit* self, int16_t* buffer, size_t length) {
+	chorus_data* data = self->data;
+	int frames = length / 2;
+	if (frames == 0) return;
+
+	for (int ch=0; ch<2; ch++) {
+		chorus_channel* c = ch ? &data->r : &data->l;
+
+		// interpolate the delay time from here to the end of the block
+		c->phase += data->phase_inc * frames;
+		int target = lfo_delay(data, c->phase);
+		int step = (target - c->current) / frames;
+		int delay = c->current;
+
+		int16_t* p = buffer + ch;
+		for (int i=0; i<frames; i++) {
+			delay += step;
+			*p = clip(chorus_run(data, c, *p, delay));
+			p += 2;
+		}
+		c->current = target;
+	}
+}
+
+
+// getters and setters:
+
+static int get_dry(nocta_unit* self) {
+	chorus_data* data = self->data;
+	return data->dry;
+}
+static void set_dry(nocta_unit* self, int dry) {
+	chorus_data* data = self->data;
+	data->dry = dry;
+}
+
+static int get_wet(nocta_unit* self) {
+	chorus_data* data = self->data;
+	return data->wet;
+}
+static void set_wet(nocta_unit* self, int wet) {
+	chorus_data* data = self->data;
+	data->wet = wet;
+}
+
+static int get_feedback(nocta_unit* self) {
+	chorus_data* data = self->data;
+	return data->feedback;
+}
+static void set_feedback(nocta_unit* self, int feedback) {
+	chorus_data* data = self->data;
+	data->feedback = feedback;
+}
+
+static int get_delay(nocta_unit* self) {
+	chorus_data* data = self->data;
+	return data->delay;
+}
+static void set_delay(nocta_unit* self, int delay) {
+	chorus_data* data = self->data;
+	data->delay = CLAMP(delay, 1, MAX_DELAY);
+	data->base = (int64_t)data->delay * data->sample_rate * 256 / 10000;
+}
+
+static int get_depth(nocta_unit* self) {
+	chorus_data* data = self->data;
+	return data->depth;
+}
+static void set_depth(nocta_unit* self, int depth) {
+	chorus_data* data = self->data;
+	data->depth = depth;
+}
+
+static int get_rate(nocta_unit* self) {
+	chorus_data* data = self->data;
+	return data->rate;
+}
+static void set_rate(nocta_unit* self, int rate) {
+	chorus_data* data = self->data;
+	data->rate = rate;
+	data->phase_inc = ((int64_t)rate << 32) / (100 * data->sample_rate);
+}
@@ -2,6 +2,7 @@
 #include "../include/nocta.h"
 #include "fixedpoint.h"
 #include "assert.h"
+#include <stddef.h>
 
 #define MAX(a,b) ((a)>(b) ? (a) : (b))
 #define MIN(a,b) ((a)<(b) ? (a) : (b))
@@ -14,12 +15,90 @@ inline static int clip(int x) {
 	return CLAMP(x, INT16_MIN, INT16_MAX);
 }
 
+// convert between 16-bit samples and float samples (from -1.0 to 1.0)
+inline static float int16_to_float(int x) {
+	return x * (1.0f / 32768);
+}
+inline static int16_t float_to_int16(float x) {
+	x *= 32768;
+	return CLAMP(x, INT16_MIN, INT16_MAX);
+}
+
+// filters produce denormal floats as they decay to silence, and those are
+// very slow on x86, so they're flushed to zero while float kernels run
+// (and float filters in the fixed point units)
+#ifdef __SSE__
+#include <xmmintrin.h>
+#define FLUSH_DENORMALS 0x8040 // flush to zero, and treat denormal inputs as zero
+
+static inline unsigned int denormals_off(void) {
+	unsigned int csr = _mm_getcsr();
+	_mm_setcsr(csr | FLUSH_DENORMALS);
+	return csr;
+}
+static inline void denormals_restore(unsigned int csr) {
+	_mm_setcsr(csr);
+}
+#else
+static inline unsigned int denormals_off(void) { return 0; }
+static inline void denormals_restore(unsigned int csr) {}
+#endif
+
+// whether a unit runs its float kernel instead of the fixed point code
+inline static bool uses_float(nocta_unit* unit) {
+	return unit->context->backend == NOCTA_BACKEND_FLOAT && unit->process_float;
+}
+
 // Convert cycles-per-second to cycles-per-sample
 inline static int normalize_hz(int f, int sample_rate) {
 	return int_to_fix(f) / sample_rate;
 }
 
 
+// switch a unit over to a preset (see preset.c)
+void preset_apply(nocta_unit* unit, const void* preset);
+// keep a copy of the unit's settings for presets to be prepared from
+// (done by nocta_create, and again by constructors which set more up after it)
+void preset_snapshot(nocta_unit* unit);
+
+// apply the unit's events that are due `pos` frames into its current block,
+// and return the position of the next one (or `frames` if there isn't one)
+size_t run_events(nocta_unit* unit, size_t pos, size_t frames);
+
+// longest block automation is run for in one go (see automation.c)
+#define AUTOMATION_FRAMES 256
+
+// take over any lanes set since the last call, on the processing thread
+void update_automation(nocta_unit* unit);
+// move the unit's automation lanes along a block of up to AUTOMATION_FRAMES frames
+void run_automation(nocta_unit* unit, size_t frames);
+void automation_free(nocta_unit* unit);
+
+// whether any of the unit's events are due in its next `frames` frames
+bool events_due(nocta_unit* unit, size_t frames);
+
+
+// fusing chains of units (see graph.c):
+// the gain of each channel of a gainer (in 16:16), or false if it's modulated
+bool gainer_gain(nocta_unit* gainer, int* l, int* r);
+// scale a filter's output by `gain` (16:16) on top of its volume, in place
+// of the gainers before it
+void bqfilter_fold(nocta_unit* filter, int gain);
+void svfilter_fold(nocta_unit* filter, int gain);
+
+
+// mark the time spent processing `frames` frames, for the real-time checks (see rtcheck.c)
+#ifdef NOCTA_RTCHECK
+void rt_enter(int sample_rate, size_t frames);
+void rt_leave(void);
+#define RT_ENTER(sample_rate, frames) rt_enter(sample_rate, frames)
+#define RT_LEAVE() rt_leave()
+#else
+#define RT_ENTER(sample_rate, frames) ((void)0)
+#define RT_LEAVE() ((void)0)
+#endif
+
+
 // allocates memory for a type, and initialises it at the same time
 #define ialloc(t, ...) ialloc_impl(sizeof(t), &(t){ __VA_ARGS__ })
 
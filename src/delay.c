@@ -1,8 +1,12 @@
 #include "common.h"
+#include "delayline.h"
 
 // max delay time in seconds:
 #define MAX_TIME 4
 
+// number of samples taken to reach a new delay time
+#define GLIDE_TIME 1024
+
 int get_dry(nocta_unit* self);
 void set_dry(nocta_unit* self, int dry);
 int get_wet(nocta_unit* self);
@@ -11,71 +15,105 @@ int get_feedback(nocta_unit* self);
 void set_feedback(nocta_unit* self, int feedback);
 int get_time(nocta_unit* self);
 void set_time(nocta_unit* self, int t);
+static void modulate_time(nocta_unit* self, const int* values);
 
 static nocta_param delay_params[] = {
 	{"dry", 0, 255, get_dry, set_dry},
 	{"wet", 0, 255, get_wet, set_wet},
 	{"feedback", 0, 255, get_feedback, set_feedback},
-	{"time", 0, 255, get_time, set_time}
+	{"time", 0, 255, get_time, set_time, modulate_time}
 };
 
 typedef struct {
-	int16_t* pre_samples; // initial delay
-	int16_t* samples;     // feedback delay
-	int size;
-	int i, j;             // i = current position, j = future position
+	delay_line pre;       // initial delay
+	delay_line feedback;  // feedback delay
+	delay_line_f pre_f, feedback_f; // used instead by the float backend
 } delay_buffer;
 
 typedef struct {
+	// parameters and derived values (captured by presets):
 	uint8_t dry, wet;
 	uint8_t feedback;
 	int delay_time;
-	delay_buffer l, r;
+	int target;           // delay in samples (24:8) once the glide ends
 	int sample_rate;
+	
+	// state:
+	int current;          // delay in samples (24:8) right now
+	int step, glide;      // how much to move per sample, and for how many samples
+	int glide_target;     // the target that the current glide is heading to
+	delay_buffer l, r;
+	const int* mod_time;
 } delay_data;
 
+static inline void delay_advance(delay_data* data);
+static inline void delay_follow(delay_data* data, int t);
 static inline int delay_run(delay_data* data, delay_buffer* b, int x);
 static int delay_l(nocta_unit* self, int x);
 static int delay_r(nocta_unit* self, int x);
+static void delay_buffer_run(nocta_unit* self, int16_t* buffer, size_t length);
+static void delay_float(nocta_unit* self, float* buffer, size_t length);
 static void delay_free(nocta_unit* self);
 
 nocta_unit* nocta_delay(nocta_context* context) {
 	
-	int buffer_size = 2 * MAX_TIME * context->sample_rate;
-	int alloc_size = sizeof(int16_t) * buffer_size;
+	int length = MAX_TIME * context->sample_rate + 1;
 	
 	delay_data* data = ialloc(delay_data,
 		.dry = 255,
 		.wet = 127,
 		.feedback = 100,
-		.l = (delay_buffer){ malloc(alloc_size), malloc(alloc_size), buffer_size },
-		.r = (delay_buffer){ malloc(alloc_size), malloc(alloc_size), buffer_size },
 		.sample_rate = context->sample_rate
 	);
 	
+	// only allocate the lines that the backend will use
+	delay_buffer* buffers[] = { &data->l, &data->r };
+	for (int i=0; i<2; i++) {
+		if (context->backend == NOCTA_BACKEND_FLOAT) {
+			buffers[i]->pre_f = delay_line_f_create(length);
+			buffers[i]->feedback_f = delay_line_f_create(length);
+		} else {
+			buffers[i]->pre = delay_line_create(length);
+			buffers[i]->feedback = delay_line_create(length);
+		}
+	}
+	
 	nocta_unit* self = nocta_create(context, 
 		.name = "delay",
 		.data = data,
 		.process_l = delay_l,
 		.process_r = delay_r,
+		.process_buffer = delay_buffer_run,
+		.process_float = delay_float,
 		.free = delay_free,
+		.preset_size = offsetof(delay_data, current),
 		.params = delay_params,
 		.num_params = NOCTA_DELAY_NUM_PARAMS);
 	
 	set_time(self, 127);
+	data->current = data->glide_target = data->target;
+	preset_snapshot(self);
 	return self;
 }
 
 static void delay_free(nocta_unit* self) {
 	delay_data* data = self->data;
-	free(data->l.pre_samples);
-	free(data->l.samples);
-	free(data->r.pre_samples);
-	free(data->r.samples);
+	delay_line_free(&data->l.pre);
+	delay_line_free(&data->l.feedback);
+	delay_line_free(&data->r.pre);
+	delay_line_free(&data->r.feedback);
+	delay_line_f_free(&data->l.pre_f);
+	delay_line_f_free(&data->l.feedback_f);
+	delay_line_f_free(&data->r.pre_f);
+	delay_line_f_free(&data->r.feedback_f);
 }
 
 static int delay_l(nocta_unit* self, int x) {
 	delay_data* data = self->data;
+	if (data->mod_time)
+		delay_follow(data, data->mod_time[self->block_pos]);
+	else
+		delay_advance(data);
 	return delay_run(data, &data->l, x);
 }
 
@@ -84,23 +122,78 @@ static int delay_r(nocta_unit* self, int x) {
 	return delay_run(data, &data->r, x);
 }
 
+static void delay_buffer_run(nocta_unit* self, int16_t* buffer, size_t length) {
+	delay_data* data = self->data;
+	const int* mod = data->mod_time ? data->mod_time + self->block_pos : NULL;
+	for (size_t i=0; i<length/2; i++) {
+		if (mod)
+			delay_follow(data, mod[i]);
+		else
+			delay_advance(data);
+		buffer[0] = clip(delay_run(data, &data->l, buffer[0]));
+		buffer[1] = clip(delay_run(data, &data->r, buffer[1]));
+		buffer += 2;
+	}
+}
+
+// move the delay time towards its target, so changing it doesn't click
+static inline void delay_advance(delay_data* data) {
+	if (data->target != data->glide_target) {
+		data->glide_target = data->target;
+		data->step = (data->target - data->current) / GLIDE_TIME;
+		data->glide = GLIDE_TIME;
+	}
+	if (data->glide > 0) {
+		data->glide--;
+		data->current = data->glide ? data->current + data->step : data->target;
+	}
+}
+
+// jump straight to a modulated delay time (which should already be smooth)
+static inline void delay_follow(delay_data* data, int t) {
+	data->current = CLAMP(t, 1, MAX_TIME*256 - 1) * data->sample_rate;
+	data->glide = 0;
+	data->glide_target = -1; // glide back to the target once modulation stops
+}
+
 static inline int delay_run(delay_data* data, delay_buffer* b, int in) {
-	if (b->i >= b->size) b->i = 0;
-	b->j = b->i - (data->delay_time * data->sample_rate >> 8);
-	if (b->j < 0) b->j += b->size;
-	
-	b->pre_samples[b->i] = in;
+	int out = delay_line_read(&b->pre, data->current);
+	out += data->feedback * delay_line_read(&b->feedback, data->current) >> 8;
 	
-	int out = b->pre_samples[b->j];
-	out += data->feedback * b->samples[b->j] >> 8;
-	
-	b->samples[b->i] = out;
-	b->i++;
+	delay_line_write(&b->pre, in);
+	delay_line_write(&b->feedback, clip(out));
 	
 	return (in * data->dry >> 8)
 	     + (out * data->wet >> 8);
 }
 
+static inline float delay_run_float(delay_data* data, delay_buffer* b, float in,
+                                    float dry, float wet, float feedback) {
+	float out = delay_line_f_read(&b->pre_f, data->current);
+	out += feedback * delay_line_f_read(&b->feedback_f, data->current);
+	
+	delay_line_f_write(&b->pre_f, in);
+	delay_line_f_write(&b->feedback_f, out);
+	
+	return in * dry + out * wet;
+}
+
+static void delay_float(nocta_unit* self, float* buffer, size_t length) {
+	delay_data* data = self->data;
+	float dry = data->dry / 256.0f;
+	float wet = data->wet / 256.0f;
+	float feedback = data->feedback / 256.0f;
+	const int* mod = data->mod_time ? data->mod_time + self->block_pos : NULL;
+	for (size_t i=0; i<length; i+=2) {
+		if (mod)
+			delay_follow(data, mod[i/2]);
+		else
+			delay_advance(data);
+		buffer[i] = delay_run_float(data, &data->l, buffer[i], dry, wet, feedback);
+		buffer[i+1] = delay_run_float(data, &data->r, buffer[i+1], dry, wet, feedback);
+	}
+}
+
 
 // getters and setters:
 
@@ -138,4 +231,12 @@ int get_time(nocta_unit* self) {
 void set_time(nocta_unit* self, int t) {
 	delay_data* data = self->data;
 	data->delay_time = CLAMP(t, 1, MAX_TIME*256 - 1);
-}
\ No newline at end of file
+	
+	// time is in 1/256 seconds, so this gives samples in 24:8 fixed point
+	data->target = data->delay_time * data->sample_rate;
+}
+
+static void modulate_time(nocta_unit* self, const int* values) {
+	delay_data* data = self->data;
+	data->mod_time = values;
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include "common.h"
+
+// Circular sample buffer shared by the delay based units.
+// The size is a power of 2, so positions can wrap with a mask.
+
+typedef struct {
+	int16_t* samples;
+	int mask;
+	int pos;    // where the next sample will be written
+} delay_line;
+
+// allocate a silent line that can hold at least `length` samples
+inline static delay_line delay_line_create(int length) {
+	int size = 1;
+	while (size <= length) size *= 2;
+	return (delay_line){ calloc(size, sizeof(int16_t)), size - 1, 0 };
+}
+
+inline static void delay_line_free(delay_line* d) {
+	free(d->samples);
+}
+
+inline static void delay_line_write(delay_line* d, int x) {
+	d->samples[d->pos & d->mask] = x;
+	d->pos++;
+}
+
+// read the line `delay` samples ago, where delay is in 24:8 fixed point
+// and at least 1.0 (fractional positions are linearly interpolated)
+inline static int delay_line_read(delay_line* d, int delay) {
+	int i = d->pos - (delay >> 8);
+	int frac = delay & 0xff;
+	int a = d->samples[i & d->mask];
+	int b = d->samples[(i-1) & d->mask];
+	return a + ((b - a) * frac >> 8);
+}
+
+
+// The same for float samples (used by the float backend)
+
+typedef struct {
+	float* samples;
+	int mask;
+	int pos;
+} delay_line_f;
+
+inline static delay_line_f delay_line_f_create(int length) {
+	int size = 1;
+	while (size <= length) size *= 2;
+	return (delay_line_f){ calloc(size, sizeof(float)), size - 1, 0 };
+}
+
+inline static void delay_line_f_free(delay_line_f* d) {
+	free(d->samples);
+}
+
+inline static void delay_line_f_write(delay_line_f* d, float x) {
+	d->samples[d->pos & d->mask] = x;
+	d->pos++;
+}
+
+inline static float delay_line_f_read(delay_line_f* d, int delay) {
+	int i = d->pos - (delay >> 8);
+	float frac = (delay & 0xff) * (1.0f / 256);
+	float a = d->samples[i & d->mask];
+	float b = d->samples[(i-1) & d->mask];
+	return a + (b - a) * frac;
+}
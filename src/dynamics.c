@@ -0,0 +1,333 @@
+#include "common.h"
+
+// Compressor and lookahead limiter.
+// The peak level of both channels is tracked over a sliding window with a
+// monotonic queue: every sample drops the queued peaks that are no louder
+// than it, so the front of the queue is always the window's maximum, for
+// O(1) work per sample on average.
+// The gain is worked out every CONTROL_STEP frames in the log2 domain, and
+// ramped linearly in between. The sound is delayed by the lookahead time, and
+// the window covers the lookahead plus one step, so the limiter's gain can
+// reach its target before the peak that caused it comes out.
+
+#define CONTROL_STEP 16      // frames per gain update
+#define MAX_LOOKAHEAD 10     // ms
+
+// gains are in 4:12, as the makeup gain can go up to 16x
+#define GAIN_PT 12
+
+static int get_mode(nocta_unit* self);
+static void set_mode(nocta_unit* self, int mode);
+static int get_threshold(nocta_unit* self);
+static void set_threshold(nocta_unit* self, int threshold);
+static int get_ratio(nocta_unit* self);
+static void set_ratio(nocta_unit* self, int ratio);
+static int get_attack(nocta_unit* self);
+static void set_attack(nocta_unit* self, int attack);
+static int get_release(nocta_unit* self);
+static void set_release(nocta_unit* self, int release);
+static int get_lookahead(nocta_unit* self);
+static void set_lookahead(nocta_unit* self, int lookahead);
+static int get_gain(nocta_unit* self);
+static void set_gain(nocta_unit* self, int gain);
+
+static nocta_param dynamics_params[] = {
+	{"mode", 0, NOCTA_DYNAMICS_NUM_MODES-1, get_mode, set_mode},
+	{"threshold", 0, 60, get_threshold, set_threshold},
+	{"ratio", 1, 20, get_ratio, set_ratio},
+	{"attack", 0, 200, get_attack, set_attack},
+	{"release", 1, 2000, get_release, set_release},
+	{"lookahead", 0, MAX_LOOKAHEAD, get_lookahead, set_lookahead},
+	{"gain", 0, 24, get_gain, set_gain}
+};
+
+typedef struct {
+	// parameters and derived values (captured by presets):
+	int mode;
+	int threshold, ratio;
+	int attack, release;
+	int lookahead;
+	int gain;
+	int threshold_log;    // threshold level, as log2 of the sample value (16:16)
+	int gain_log;         // makeup gain (16:16)
+	int attack_steps;     // control steps taken to reach a lower gain
+	int release_coef;     // one-pole coefficient per control step (16:16)
+	int delay;            // lookahead in frames
+	int window;           // frames covered by the peak detector
+	int sample_rate;
+
+	// state:
+	int16_t* line;        // lookahead delay line (interleaved stereo)
+	int line_mask;
+	uint32_t pos;         // frames written to the line so far
+	int* peak_value;      // monotonic queue of peaks (decreasing from the front)
+	uint32_t* peak_time;  // frame each queued peak came from
+	int queue_mask;
+	uint32_t head, tail;
+	int count;            // frames until the next gain update
+	int env;              // current gain reduction (16:16 log2, <= 0)
+	int env_step;         // how much env moves per control step while attacking
+	int amp, amp_step;    // linear gain (16:16) and its step per frame
+	int in_r;             // last right input (for single-sample processing)
+} dynamics_data;
+
+static inline int log2_fix(int x);
+static inline int exp2_fix(int x);
+static inline void push_peak(dynamics_data* data, int peak);
+static void update_gain(dynamics_data* data);
+static inline void dynamics_run(dynamics_data* data, int in_l, int in_r, int* out_l, int* out_r);
+static int dynamics_l(nocta_unit* self, int x);
+static int dynamics_r(nocta_unit* self, int x);
+static void dynamics_buffer(nocta_unit* self, int16_t* buffer, size_t length);
+static void dynamics_free(nocta_unit* self);
+
+static nocta_unit* dynamics_create(nocta_context* context, char* name, int mode,
+                                   int threshold, int ratio, int attack,
+                                   int release, int lookahead) {
+
+	int line_size = 1;
+	while (line_size <= MAX_LOOKAHEAD * context->sample_rate / 1000) line_size *= 2;
+	int queue_size = 1;
+	while (queue_size <= MAX_LOOKAHEAD * context->sample_rate / 1000 + CONTROL_STEP) queue_size *= 2;
+
+	dynamics_data* data = ialloc(dynamics_data,
+		.sample_rate = context->sample_rate,
+		.line = calloc(line_size * 2, sizeof(int16_t)),
+		.line_mask = line_size - 1,
+		.peak_value = malloc(queue_size * sizeof(int)),
+		.peak_time = malloc(queue_size * sizeof(uint32_t)),
+		.queue_mask = queue_size - 1,
+		.amp = 1 << 16
+	);
+
+	nocta_unit* self = nocta_create(
+		.context = context,
+		.name = name,
+		.data = data,
+		.process_l = dynamics_l,
+		.process_r = dynamics_r,
+		.process_buffer = dynamics_buffer,
+		.free = dynamics_free,
+		.preset_size = offsetof(dynamics_data, line),
+		.params = dynamics_params,
+		.num_params = NOCTA_DYNAMICS_NUM_PARAMS
+	);
+
+	set_mode(self, mode);
+	set_threshold(self, threshold);
+	set_ratio(self, ratio);
+	set_attack(self, attack);
+	set_release(self, release);
+	set_lookahead(self, lookahead);
+	set_gain(self, 0);
+	preset_snapshot(self);
+	return self;
+}
+
+nocta_unit* nocta_compressor(nocta_context* context) {
+	return dynamics_create(context, "compressor", NOCTA_DYNAMICS_COMPRESSOR, 18, 4, 10, 150, 0);
+}
+
+nocta_unit* nocta_limiter(nocta_context* context) {
+	return dynamics_create(context, "limiter", NOCTA_DYNAMICS_LIMITER, 1, 20, 0, 100, 5);
+}
+
+static void dynamics_free(nocta_unit* self) {
+	dynamics_data* data = self->data;
+	free(data->line);
+	free(data->peak_value);
+	free(data->peak_time);
+}
+
+// log2 of a positive integer, in 16:16 (within about 0.01)
+static inline int log2_fix(int x) {
+	int e = 31 - __builtin_clz(x);
+	int f = (int)(((uint32_t)x << (31 - e)) >> 15) - 65536; // fraction of the mantissa
+	return (e << 16) + f + (int)((int64_t)f * (65536 - f) * 22713 >> 32);
+}
+
+// 2^x, where x and the result are in 16:16 (x must be below 15)
+static inline int exp2_fix(int x) {
+	int i = x >> 16;
+	int f = x & 0xffff;
+	int m = 65536 + f - (int)((int64_t)f * (65536 - f) * 22512 >> 32);
+	return i >= 0 ? m << i : (i > -31 ? m >> -i : 0);
+}
+
+// add a frame's peak to the queue, and drop any that have left the window
+static inline void push_peak(dynamics_data* data, int peak) {
+	int mask = data->queue_mask;
+	uint32_t time = data->pos;
+	while (data->tail != data->head && data->peak_value[(data->tail - 1) & mask] <= peak)
+		data->tail--;
+	data->peak_value[data->tail & mask] = peak;
+	data->peak_time[data->tail & mask] = time;
+	data->tail++;
+	while ((int32_t)(time - data->peak_time[data->head & mask]) >= data->window)
+		data->head++;
+}
+
+// work out the gain for the next control step from the window's peak
+static void update_gain(dynamics_data* data) {
+	int peak = data->peak_value[data->head & data->queue_mask];
+	int over = log2_fix(MAX(peak, 1)) - data->threshold_log;
+	int target = 0;
+	if (over > 0) {
+		target = data->mode == NOCTA_DYNAMICS_LIMITER ? -over : over / data->ratio - over;
+	}
+
+	if (target < data->env) {
+		// attack: ramp down so the target is reached in time, only ever
+		// getting steeper, so earlier peaks still get there in time too
+		int step = (target - data->env) / data->attack_steps - 1;
+		data->env_step = MIN(data->env_step, step);
+		data->env = MAX(data->env + data->env_step, target);
+	} else {
+		// release
+		data->env_step = 0;
+		data->env += (int)((int64_t)(target - data->env) * data->release_coef >> 16);
+	}
+
+	int amp = exp2_fix(data->env + data->gain_log);
+	data->amp_step = (amp - data->amp) / CONTROL_STEP;
+}
+
+static inline void dynamics_run(dynamics_data* data, int in_l, int in_r, int* out_l, int* out_r) {
+	push_peak(data, MAX(abs(in_l), abs(in_r)));
+	if (--data->count <= 0) {
+		data->count = CONTROL_STEP;
+		update_gain(data);
+	}
+
+	int16_t* line = data->line;
+	int mask = data->line_mask;
+	uint32_t pos = data->pos++;
+	line[(pos & mask) * 2] = in_l;
+	line[(pos & mask) * 2 + 1] = in_r;
+	uint32_t read = (pos - data->delay) & mask;
+
+	data->amp += data->amp_step;
+	int amp = data->amp >> (16 - GAIN_PT);
+	*out_l = line[read * 2] * amp >> GAIN_PT;
+	*out_r = line[read * 2 + 1] * amp >> GAIN_PT;
+}
+
+// the left channel drives the detector, using the most recent right input
+static int dynamics_l(nocta_unit* self, int x) {
+	dynamics_data* data = self->data;
+	int out_l, out_r;
+	dynamics_run(data, x, data->in_r, &out_l, &out_r);
+	return out_l;
+}
+
+static int dynamics_r(nocta_unit* self, int x) {
+	dynamics_data* data = self->data;
+	data->in_r = x;
+	// the frame has already been written with the previous right input
+	uint32_t pos = (data->pos - 1) & data->line_mask;
+	data->line[pos * 2 + 1] = x;
+	uint32_t read = (data->pos - 1 - data->delay) & data->line_mask;
+	int amp = data->amp >> (16 - GAIN_PT);
+	return data->line[read * 2 + 1] * amp >> GAIN_PT;
+}
+
+static void dynamics_buffer(nocta_unit* self, int16_t* buffer, size_t length) {
+	dynamics_data* data = self->data;
+	for (size_t i=0; i<length/2; i++) {
+		int in_r = buffer[1];
+		int out_l, out_r;
+		dynamics_run(data, buffer[0], in_r, &out_l, &out_r);
+		buffer[0] = clip(out_l);
+		buffer[1] = clip(out_r);
+		data->in_r = in_r;
+		buffer += 2;
+	}
+}
+
+// recalculate everything that depends on the times
+static void update_times(dynamics_data* data) {
+	int frames_per_ms = data->sample_rate / 1000;
+	data->delay = data->lookahead * data->sample_rate / 1000;
+	data->window = data->delay + CONTROL_STEP;
+
+	// the limiter has to be fully down by the time the peak comes out
+	int attack = data->mode == NOCTA_DYNAMICS_LIMITER
+	           ? data->delay - CONTROL_STEP
+	           : data->attack * frames_per_ms;
+	data->attack_steps = MAX(attack / CONTROL_STEP, 1);
+
+	double release = (double)data->release * data->sample_rate / 1000 / CONTROL_STEP;
+	data->release_coef = (1 - exp(-1 / release)) * 65536;
+}
+
+
+// getters and setters:
+
+static int get_mode(nocta_unit* self) {
+	dynamics_data* data = self->data;
+	return data->mode;
+}
+static void set_mode(nocta_unit* self, int mode) {
+	dynamics_data* data = self->data;
+	data->mode = mode;
+	update_times(data);
+}
+
+static int get_threshold(nocta_unit* self) {
+	dynamics_data* data = self->data;
+	return data->threshold;
+}
+static void set_threshold(nocta_unit* self, int threshold) {
+	dynamics_data* data = self->data;
+	data->threshold = CLAMP(threshold, 0, 60);
+	data->threshold_log = (log2(INT16_MAX) - data->threshold * log2(10) / 20) * 65536;
+}
+
+static int get_ratio(nocta_unit* self) {
+	dynamics_data* data = self->data;
+	return data->ratio;
+}
+static void set_ratio(nocta_unit* self, int ratio) {
+	dynamics_data* data = self->data;
+	data->ratio = CLAMP(ratio, 1, 20);
+}
+
+static int get_attack(nocta_unit* self) {
+	dynamics_data* data = self->data;
+	return data->attack;
+}
+static void set_attack(nocta_unit* self, int attack) {
+	dynamics_data* data = self->data;
+	data->attack = CLAMP(attack, 0, 200);
+	update_times(data);
+}
+
+static int get_release(nocta_unit* self) {
+	dynamics_data* data = self->data;
+	return data->release;
+}
+static void set_release(nocta_unit* self, int release) {
+	dynamics_data* data = self->data;
+	data->release = CLAMP(release, 1, 2000);
+	update_times(data);
+}
+
+static int get_lookahead(nocta_unit* self) {
+	dynamics_data* data = self->data;
+	return data->lookahead;
+}
+static void set_lookahead(nocta_unit* self, int lookahead) {
+	dynamics_data* data = self->data;
+	data->lookahead = CLAMP(lookahead, 0, MAX_LOOKAHEAD);
+	update_times(data);
+}
+
+static int get_gain(nocta_unit* self) {
+	dynamics_data* data = self->data;
+	return data->gain;
+}
+static void set_gain(nocta_unit* self, int gain) {
+	dynamics_data* data = self->data;
+	data->gain = CLAMP(gain, 0, 24);
+	data->gain_log = data->gain * log2(10) / 20 * 65536;
+}
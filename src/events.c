@@ -0,0 +1,90 @@
+#include "common.h"
+
+// Scheduled parameter changes.
+// Every unit counts the frames it has processed, and events are stamped
+// with the frame on that unit's clock where they should happen. The queue
+// is sorted by those stamps, but as the units' clocks don't line up, that
+// only keeps each unit's own events in order (so ones at the same time
+// happen in the order they were scheduled). Processing a span scans the
+// whole queue, applying the unit's events that are due and finding its
+// next one, which is where the block gets split; the queue is short, so
+// that's cheap next to the processing.
+
+#define MAX_EVENTS 256
+
+typedef struct {
+	uint32_t time;
+	nocta_unit* unit;
+	int param_id;
+	int value;
+} event;
+
+struct nocta_events {
+	int count;
+	event queue[MAX_EVENTS];
+};
+
+bool nocta_schedule(nocta_unit* unit, uint32_t offset, int param_id, int value) {
+	nocta_context* context = unit->context;
+	if (!context->events) {
+		context->events = calloc(1, sizeof(struct nocta_events));
+	}
+	struct nocta_events* events = context->events;
+	if (events->count == MAX_EVENTS)
+		return false;
+
+	// insert after any events at the same time, so they happen in order
+	event e = { unit->time + offset, unit, param_id, value };
+	int i = events->count;
+	while (i > 0 && (int32_t)(events->queue[i-1].time - e.time) > 0) {
+		events->queue[i] = events->queue[i-1];
+		i--;
+	}
+	events->queue[i] = e;
+	events->count++;
+	return true;
+}
+
+void nocta_cancel(nocta_unit* unit) {
+	struct nocta_events* events = unit->context->events;
+	if (!events) return;
+	int n = 0;
+	for (int i=0; i<events->count; i++) {
+		if (events->queue[i].unit != unit)
+			events->queue[n++] = events->queue[i];
+	}
+	events->count = n;
+}
+
+size_t run_events(nocta_unit* unit, size_t pos, size_t frames) {
+	struct nocta_events* events = unit->context->events;
+	if (!events || events->count == 0)
+		return frames;
+
+	size_t next = frames;
+	int n = 0;
+	for (int i=0; i<events->count; i++) {
+		event* e = &events->queue[i];
+		int32_t offset = e->time - unit->time;
+		if (e->unit == unit && offset <= (int32_t)pos) {
+			nocta_set(unit, e->param_id, e->value);
+			continue;
+		}
+		if (e->unit == unit && offset < next) {
+			next = offset;
+		}
+		events->queue[n++] = *e;
+	}
+	events->count = n;
+	return next;
+}
+
+bool events_due(nocta_unit* unit, size_t frames) {
+	struct nocta_events* events = unit->context->events;
+	for (int i=0; events && i<events->count; i++) {
+		event* e = &events->queue[i];
+		if (e->unit == unit && (int32_t)(e->time - unit->time) < (int32_t)frames)
+			return true;
+	}
+	return false;
+}
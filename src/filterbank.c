@@ -0,0 +1,289 @@
+#include "common.h"
+
+// Bank of filters, with the coefficients and state of every band stored side
+// by side, so all bands can be run at once. The loop over the bands goes
+// LANES at a time, so the compiler can vectorize it.
+//
+// The bands run in float whatever the backend, as the low bands need more
+// precision than 3:13 (and the 64-bit products of a finer fixed point format
+// don't vectorize). Each band is a state variable filter (trapezoidal, so it
+// has the same response as the biquad in bqfilter.c), since a biquad's
+// coefficients come close to cancelling out at low frequencies, where float
+// isn't precise enough for them.
+//
+// In parallel mode each band is a bandpass filter on the same input, and the
+// outputs are mixed according to each band's gain.
+// In series mode each band is a peaking EQ fed by the previous band. To keep
+// the bands independent, band k works on the sample from k samples ago, so
+// the whole chain is updated in one pass at the cost of (bands-1) samples
+// of latency.
+
+#define MAX_BANDS 32
+#define LANES 8   // bands are processed in groups of this many
+
+static int get_vol(nocta_unit* self);
+static void set_vol(nocta_unit* self, int vol);
+static int get_mode(nocta_unit* self);
+static void set_mode(nocta_unit* self, int mode);
+static int get_bands(nocta_unit* self);
+static void set_bands(nocta_unit* self, int bands);
+static int get_low(nocta_unit* self);
+static void set_low(nocta_unit* self, int low);
+static int get_high(nocta_unit* self);
+static void set_high(nocta_unit* self, int high);
+static int get_res(nocta_unit* self);
+static void set_res(nocta_unit* self, int res);
+
+static nocta_param filterbank_params[] = {
+	{"volume", 0, 255, get_vol, set_vol},
+	{"mode", 0, NOCTA_FILTERBANK_NUM_MODES-1, get_mode, set_mode},
+	{"bands", 1, MAX_BANDS, get_bands, set_bands},
+	{"low", 20, 20000, get_low, set_low},
+	{"high", 20, 20000, get_high, set_high},
+	{"resonance", 0, 255, get_res, set_res}
+};
+
+typedef struct {
+	float ic1[MAX_BANDS], ic2[MAX_BANDS];  // the integrators of each band
+	float pipe[MAX_BANDS];                 // input waiting for each band (series mode)
+} bank_state;
+
+typedef struct {
+	// properties:
+	uint8_t vol;
+	int mode;
+	int bands;
+	int low, high;
+	uint8_t res;
+	uint8_t gain[MAX_BANDS];
+
+	// coefficients of each band (unused bands are all zero):
+	float a1[MAX_BANDS], a2[MAX_BANDS], a3[MAX_BANDS];
+	float m0[MAX_BANDS], m1[MAX_BANDS];  // amounts of the input and bandpass in the output
+	float mix[MAX_BANDS]; // output level of each band in parallel mode
+	int lanes;            // number of bands to process, rounded up to LANES
+	int sample_rate;
+
+	// state (everything above is captured by presets):
+	bank_state l, r;
+} bank_data;
+
+static void update_band(bank_data* data, int band);
+static void update_bands(bank_data* data);
+static int filterbank_run(bank_data* data, bank_state* s, int x);
+static int filterbank_l(nocta_unit* self, int x);
+static int filterbank_r(nocta_unit* self, int x);
+static void filterbank_buffer(nocta_unit* self, int16_t* buffer, size_t length);
+
+nocta_unit* nocta_filterbank(nocta_context* context) {
+
+	bank_data* data = ialloc(bank_data,
+		.vol = 255,
+		.mode = NOCTA_FILTERBANK_PARALLEL,
+		.bands = 10,
+		.low = 31,
+		.high = 16000,
+		.res = 30,
+		.sample_rate = context->sample_rate
+	);
+	memset(data->gain, 128, sizeof(data->gain));
+	update_bands(data);
+
+	return nocta_create(
+		.context = context,
+		.name = "filterbank",
+		.data = data,
+		.process_l = filterbank_l,
+		.process_r = filterbank_r,
+		.process_buffer = filterbank_buffer,
+		.params = filterbank_params,
+		.num_params = NOCTA_FILTERBANK_NUM_PARAMS,
+		.preset_size = offsetof(bank_data, l)
+	);
+}
+
+void nocta_filterbank_set_gain(nocta_unit* self, int band, int gain) {
+	bank_data* data = self->data;
+	if (band < 0 || band >= MAX_BANDS)
+		return;
+	data->gain[band] = gain;
+	if (band < data->bands)
+		update_band(data, band);
+}
+
+int nocta_filterbank_get_gain(nocta_unit* self, int band) {
+	bank_data* data = self->data;
+	if (band < 0 || band >= MAX_BANDS)
+		return 0;
+	return data->gain[band];
+}
+
+// run a group of LANES bands
+static void run_lanes(const bank_data* restrict data, bank_state* restrict s, float* restrict y, int first) {
+	for (int k=first; k<first+LANES; k++) {
+		float in = s->pipe[k];
+		float v3 = in - s->ic2[k];
+		float v1 = data->a1[k] * s->ic1[k] + data->a2[k] * v3;  // bandpass
+		float v2 = s->ic2[k] + data->a2[k] * s->ic1[k] + data->a3[k] * v3;  // lowpass
+		s->ic1[k] = 2 * v1 - s->ic1[k];
+		s->ic2[k] = 2 * v2 - s->ic2[k];
+		float out = data->m0[k] * in + data->m1[k] * v1;
+		y[k] = CLAMP(out, INT16_MIN, INT16_MAX); // saturate, like the other filters
+	}
+}
+
+static int filterbank_run(bank_data* data, bank_state* s, int x) {
+	int n = data->lanes;
+	float y[MAX_BANDS];
+
+	if (data->mode == NOCTA_FILTERBANK_SERIES)
+		s->pipe[0] = x;
+	else
+		for (int k=0; k<n; k++) s->pipe[k] = x;
+
+	// every band at once
+	for (int k=0; k<n; k+=LANES)
+		run_lanes(data, s, y, k);
+
+	float output;
+	if (data->mode == NOCTA_FILTERBANK_SERIES) {
+		// pass each band's output along to the next band
+		output = y[data->bands-1];
+		for (int k=data->bands-1; k>0; k--) s->pipe[k] = y[k-1];
+	} else {
+		output = 0;
+		for (int k=0; k<n; k++) output += y[k] * data->mix[k];
+	}
+	return lrintf(output) * data->vol >> 8;
+}
+
+static int filterbank_l(nocta_unit* self, int x) {
+	bank_data* data = self->data;
+	unsigned int csr = denormals_off();
+	int y = filterbank_run(data, &data->l, x);
+	denormals_restore(csr);
+	return y;
+}
+static int filterbank_r(nocta_unit* self, int x) {
+	bank_data* data = self->data;
+	unsigned int csr = denormals_off();
+	int y = filterbank_run(data, &data->r, x);
+	denormals_restore(csr);
+	return y;
+}
+
+static void filterbank_buffer(nocta_unit* self, int16_t* buffer, size_t length) {
+	bank_data* data = self->data;
+	unsigned int csr = denormals_off();
+	for (size_t i=0; i<length/2; i++) {
+		buffer[0] = clip(filterbank_run(data, &data->l, buffer[0]));
+		buffer[1] = clip(filterbank_run(data, &data->r, buffer[1]));
+		buffer += 2;
+	}
+	denormals_restore(csr);
+}
+
+// calculate the coefficients of a single band
+static void update_band(bank_data* data, int band) {
+	double ratio = data->bands > 1 ? (double)band / (data->bands - 1) : 0.5;
+	double freq = data->low * pow((double)data->high / data->low, ratio);
+	double g = tan(M_PI * MIN(freq, data->sample_rate * 0.45) / data->sample_rate);
+	double q = 0.5 + data->res / 32.0;
+	double k;   // damping
+
+	if (data->mode == NOCTA_FILTERBANK_SERIES) {
+		// peaking EQ: gain 128 is flat, from -12 dB to +12 dB
+		double a = pow(10, (data->gain[band] - 128) * 12.0 / 128 / 40);
+		k = 1 / (q * a);
+		data->m0[band] = 1;
+		data->m1[band] = k * (a * a - 1);
+		data->mix[band] = 0;
+	} else {
+		// bandpass with 0 dB peak gain
+		k = 1 / q;
+		data->m0[band] = 0;
+		data->m1[band] = k;
+		data->mix[band] = data->gain[band] / 128.0f;
+	}
+
+	double a1 = 1 / (1 + g * (g + k));
+	data->a1[band] = a1;
+	data->a2[band] = g * a1;
+	data->a3[band] = g * g * a1;
+}
+
+// calculate the coefficients of every band
+static void update_bands(bank_data* data) {
+	data->lanes = (data->bands + LANES-1) / LANES * LANES;
+	for (int k=0; k<MAX_BANDS; k++) {
+		if (k < data->bands) {
+			update_band(data, k);
+		} else {
+			data->a1[k] = data->a2[k] = data->a3[k] = 0;
+			data->m0[k] = data->m1[k] = 0;
+			data->mix[k] = 0;
+		}
+	}
+}
+
+
+// getters and setters:
+
+static int get_vol(nocta_unit* self) {
+	bank_data* data = self->data;
+	return data->vol;
+}
+static void set_vol(nocta_unit* self, int vol) {
+	bank_data* data = self->data;
+	data->vol = vol;
+}
+
+static int get_mode(nocta_unit* self) {
+	bank_data* data = self->data;
+	return data->mode;
+}
+static void set_mode(nocta_unit* self, int mode) {
+	bank_data* data = self->data;
+	data->mode = mode;
+	update_bands(data);
+}
+
+static int get_bands(nocta_unit* self) {
+	bank_data* data = self->data;
+	return data->bands;
+}
+static void set_bands(nocta_unit* self, int bands) {
+	bank_data* data = self->data;
+	data->bands = CLAMP(bands, 1, MAX_BANDS);
+	update_bands(data);
+}
+
+static int get_low(nocta_unit* self) {
+	bank_data* data = self->data;
+	return data->low;
+}
+static void set_low(nocta_unit* self, int low) {
+	bank_data* data = self->data;
+	data->low = MAX(low, 1);
+	update_bands(data);
+}
+
+static int get_high(nocta_unit* self) {
+	bank_data* data = self->data;
+	return data->high;
+}
+static void set_high(nocta_unit* self, int high) {
+	bank_data* data = self->data;
+	data->high = MAX(high, 1);
+	update_bands(data);
+}
+
+static int get_res(nocta_unit* self) {
+	bank_data* data = self->data;
+	return data->res;
+}
+static void set_res(nocta_unit* self, int res) {
+	bank_data* data = self->data;
+	data->res = res;
+	update_bands(data);
+}
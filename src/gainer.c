@@ -4,19 +4,27 @@ static int get_vol(nocta_unit* self);
 static void set_vol(nocta_unit* self, int vol);
 static int get_pan(nocta_unit* self);
 static void set_pan(nocta_unit* self, int pan);
+static void modulate_vol(nocta_unit* self, const int* values);
+static void modulate_pan(nocta_unit* self, const int* values);
 
 static nocta_param gainer_params[] = {
-	{"vol",    0, 255, get_vol, set_vol},
-	{"pan", -127, 127, get_pan, set_pan}
+	{"vol",    0, 255, get_vol, set_vol, modulate_vol},
+	{"pan", -127, 127, get_pan, set_pan, modulate_pan}
 };
 
 typedef struct {
 	uint8_t vol;
 	int8_t pan;
+	
+	// modulation (everything above is captured by presets):
+	const int* mod_vol;
+	const int* mod_pan;
 } gainer_data;
 
 static int gainer_process_l(nocta_unit* self, int in);
 static int gainer_process_r(nocta_unit* self, int in);
+static void gainer_process_buffer(nocta_unit* self, int16_t* buffer, size_t length);
+static void gainer_process_float(nocta_unit* self, float* buffer, size_t length);
 
 nocta_unit* nocta_gainer(nocta_context* context) {
 	
@@ -29,26 +37,107 @@ nocta_unit* nocta_gainer(nocta_context* context) {
 		),
 		.process_l = gainer_process_l,
 		.process_r = gainer_process_r,
+		.process_buffer = gainer_process_buffer,
+		.process_float = gainer_process_float,
 		.params = gainer_params,
-		.num_params = NOCTA_GAINER_NUM_PARAMS
+		.num_params = NOCTA_GAINER_NUM_PARAMS,
+		.preset_size = offsetof(gainer_data, mod_vol)
 	);
 }
 
 
+// amplitudes of each channel, where 128 = 100%
+static inline int amp_l(int vol, int pan) {
+	int amp = 255;
+	if (pan > 0) amp -= 2 * pan;
+	return amp * vol >> 8;
+}
+static inline int amp_r(int vol, int pan) {
+	int amp = 255;
+	if (pan < 0) amp += 2 * pan;
+	return amp * vol >> 8;
+}
+
+// volume and pan for a frame of the current block
+static inline int frame_vol(gainer_data* data, size_t i) {
+	return data->mod_vol ? CLAMP(data->mod_vol[i], 0, 255) : data->vol;
+}
+static inline int frame_pan(gainer_data* data, size_t i) {
+	return data->mod_pan ? CLAMP(data->mod_pan[i], -127, 127) : data->pan;
+}
+
 static int gainer_process_l(nocta_unit* self, int in) {
 	gainer_data* data = self->data;
-	int amp = 255;
-	if (data->pan > 0) amp -= 2 * data->pan;
-	amp = amp * data->vol >> 8;
-	return in * amp >> 7;
+	size_t i = self->block_pos;
+	return in * amp_l(frame_vol(data, i), frame_pan(data, i)) >> 7;
 }
 
 static int gainer_process_r(nocta_unit* self, int in) {
 	gainer_data* data = self->data;
-	int amp = 255;
-	if (data->pan < 0) amp += 2 * data->pan;
-	amp = amp * data->vol >> 8;
-	return in * amp >> 7;
+	size_t i = self->block_pos;
+	return in * amp_r(frame_vol(data, i), frame_pan(data, i)) >> 7;
+}
+
+static void gainer_process_buffer(nocta_unit* self, int16_t* buffer, size_t length) {
+	gainer_data* data = self->data;
+	
+	if (!data->mod_vol && !data->mod_pan) {
+		int l = amp_l(data->vol, data->pan);
+		int r = amp_r(data->vol, data->pan);
+		for (size_t i=0; i<length; i+=2) {
+			buffer[i] = clip(buffer[i] * l >> 7);
+			buffer[i+1] = clip(buffer[i+1] * r >> 7);
+		}
+		return;
+	}
+	
+	for (size_t i=0; i<length; i+=2) {
+		int vol = frame_vol(data, self->block_pos + i/2);
+		int pan = frame_pan(data, self->block_pos + i/2);
+		buffer[i] = clip(buffer[i] * amp_l(vol, pan) >> 7);
+		buffer[i+1] = clip(buffer[i+1] * amp_r(vol, pan) >> 7);
+	}
+}
+
+// the float amplitudes skip the rounding of the fixed point ones
+static inline float float_amp(int vol, int pan) {
+	return (255 - 2 * MAX(pan, 0)) * vol * (1.0f / (256 * 128));
+}
+
+static void gainer_process_float(nocta_unit* self, float* buffer, size_t length) {
+	gainer_data* data = self->data;
+	
+	if (!data->mod_vol && !data->mod_pan) {
+		float l = float_amp(data->vol, data->pan);
+		float r = float_amp(data->vol, -data->pan);
+		for (size_t i=0; i<length; i+=2) {
+			buffer[i] *= l;
+			buffer[i+1] *= r;
+		}
+		return;
+	}
+	
+	for (size_t i=0; i<length; i+=2) {
+		int vol = frame_vol(data, self->block_pos + i/2);
+		int pan = frame_pan(data, self->block_pos + i/2);
+		buffer[i] *= float_amp(vol, pan);
+		buffer[i+1] *= float_amp(vol, -pan);
+	}
+}
+
+bool gainer_gain(nocta_unit* self, int* l, int* r) {
+	gainer_data* data = self->data;
+	if (data->mod_vol || data->mod_pan)
+		return false;
+	if (uses_float(self)) {
+		// the float amplitudes, which aren't rounded
+		*l = (255 - 2 * MAX(data->pan, 0)) * data->vol * 2;
+		*r = (255 + 2 * MIN(data->pan, 0)) * data->vol * 2;
+	} else {
+		*l = amp_l(data->vol, data->pan) << 9;
+		*r = amp_r(data->vol, data->pan) << 9;
+	}
+	return true;
 }
 
 
@@ -71,3 +160,12 @@ static void set_pan(nocta_unit* self, int pan) {
 	gainer_data* data = self->data;
 	data->pan = pan;
 }
+
+static void modulate_vol(nocta_unit* self, const int* values) {
+	gainer_data* data = self->data;
+	data->mod_vol = values;
+}
+static void modulate_pan(nocta_unit* self, const int* values) {
+	gainer_data* data = self->data;
+	data->mod_pan = values;
+}
@@ -0,0 +1,512 @@
+#include "common.h"
+
+// Routing graph.
+// nocta_graph_build sorts the nodes so each one comes after its inputs, and
+// works out when each node's output is last read. A node then writes into the
+// buffer of an input that nothing reads afterwards, so its unit processes it
+// in place, or else into a free buffer from the context's pool. Buffers go
+// back to the pool as soon as their last reader has run, so a chain of any
+// length only touches the caller's block, and a branching graph only needs
+// as many buffers as there are branches alive at once.
+//
+// nocta_graph_compile also looks for runs of gainers in a chain (recognised by
+// name), and turns each run into a single multiply, or folds it into the
+// volume of a filter that follows it. The combined gain is only worked out
+// again when one of the gainers has changed. In a block where one of them
+// can't be fused (it's modulated, automated, or has an event or a preset
+// due), the run is processed unit by unit as usual.
+
+#define HOST_SLOT -1   // the block passed to nocta_graph_process
+#define NO_SLOT -2
+
+#define NO_GROUP -1
+#define FUSED -2       // a gainer processed along with the rest of its run
+
+#define MAX_GAIN (1 << 24)      // combined gains are kept below this (16:16)
+#define MAX_FOLD (4 << 16)      // largest gain folded into a filter's volume
+
+// block buffers shared by all the graphs of a context, which can't be
+// processing at the same time
+struct nocta_pool {
+	size_t stride;     // bytes per buffer
+	int count;
+	char memory[];
+};
+
+typedef struct {
+	int from, to;
+} graph_edge;
+
+typedef struct {
+	nocta_unit* unit;
+	int slot;          // buffer holding the node's output
+	int first, count;  // the node's inputs, in graph->inputs
+	int group;         // run of gainers the node processes (or NO_GROUP, or FUSED)
+} graph_node;
+
+// a run of gainers, fused into one multiply
+typedef struct {
+	int first, count;            // the gainers, in graph->fused
+	nocta_unit* filter;          // filter that follows them, if any
+	void (*fold)(nocta_unit* filter, int gain);
+	int folded;                  // gain the filter currently has (16:16)
+	int gain_l, gain_r;          // combined (16:16)
+	float gain_lf, gain_rf;
+} fused_group;
+
+struct nocta_graph {
+	nocta_context* context;
+	graph_node* nodes;
+	int num_nodes;
+	graph_edge* edges;
+	int num_edges;
+
+	// set by nocta_graph_build:
+	int* order;        // nodes in processing order
+	int* inputs;       // inputs of each node (processed in place if it's the first)
+	int num_slots;
+	size_t max_length;
+	bool built;
+
+	// set by nocta_graph_compile:
+	fused_group* groups;
+	int num_groups;
+	nocta_unit** fused;  // gainers of each group
+	int* gains;          // gain of each of them (l, r) when it was last seen
+	int num_fused;
+};
+
+static size_t sample_size(nocta_context* context) {
+	return context->backend == NOCTA_BACKEND_FLOAT ? sizeof(float) : sizeof(int16_t);
+}
+
+// make sure the pool has at least `count` buffers of `size` bytes
+static void reserve_pool(nocta_context* context, int count, size_t size) {
+	struct nocta_pool* pool = context->pool;
+	size = (size + 63) & ~(size_t)63; // keep buffers on separate cache lines
+	if (pool && pool->count >= count && pool->stride >= size)
+		return;
+
+	if (pool) {
+		count = MAX(count, pool->count);
+		size = MAX(size, pool->stride);
+	}
+	free(pool);
+	pool = malloc(sizeof(struct nocta_pool) + count * size);
+	pool->stride = size;
+	pool->count = count;
+	context->pool = pool;
+}
+
+static void* slot_buffer(nocta_graph* graph, int16_t* host, int slot) {
+	if (slot == HOST_SLOT) return host;
+	struct nocta_pool* pool = graph->context->pool;
+	return pool->memory + slot * pool->stride;
+}
+
+nocta_graph* nocta_graph_create(nocta_context* context) {
+	nocta_graph* graph = ialloc(nocta_graph, .context = context);
+	nocta_graph_add(graph, NULL); // NOCTA_GRAPH_INPUT
+	nocta_graph_add(graph, NULL); // NOCTA_GRAPH_OUTPUT
+	return graph;
+}
+
+// give back the gain of any filters with gainers folded in, and forget the groups
+static void unfuse(nocta_graph* graph) {
+	for (int i=0; i<graph->num_groups; i++) {
+		fused_group* group = &graph->groups[i];
+		if (group->filter) group->fold(group->filter, 65536);
+	}
+	for (int k=0; k<graph->num_nodes; k++) graph->nodes[k].group = NO_GROUP;
+	graph->num_groups = 0;
+	graph->num_fused = 0;
+}
+
+void nocta_graph_free(nocta_graph* graph) {
+	unfuse(graph);
+	free(graph->groups);
+	free(graph->fused);
+	free(graph->gains);
+	free(graph->nodes);
+	free(graph->edges);
+	free(graph->order);
+	free(graph->inputs);
+	free(graph);
+}
+
+int nocta_graph_add(nocta_graph* graph, nocta_unit* unit) {
+	graph->nodes = realloc(graph->nodes, (graph->num_nodes + 1) * sizeof(graph_node));
+	graph->nodes[graph->num_nodes] = (graph_node){ .unit = unit, .group = NO_GROUP };
+	graph->built = false;
+	return graph->num_nodes++;
+}
+
+bool nocta_graph_connect(nocta_graph* graph, int from, int to) {
+	if (from < 0 || from >= graph->num_nodes || to < 0 || to >= graph->num_nodes)
+		return false;
+	if (from == NOCTA_GRAPH_OUTPUT || to == NOCTA_GRAPH_INPUT || from == to)
+		return false;
+	for (int i=0; i<graph->num_edges; i++) {
+		if (graph->edges[i].from == from && graph->edges[i].to == to)
+			return true;
+	}
+	graph->edges = realloc(graph->edges, (graph->num_edges + 1) * sizeof(graph_edge));
+	graph->edges[graph->num_edges++] = (graph_edge){ from, to };
+	graph->built = false;
+	return true;
+}
+
+int nocta_graph_buffers(nocta_graph* graph) {
+	return graph->num_slots;
+}
+
+bool nocta_graph_build(nocta_graph* graph, size_t max_length) {
+	int n = graph->num_nodes;
+	graph_node* nodes = graph->nodes;
+	graph->built = false;
+	unfuse(graph);
+	graph->max_length = max_length & ~(size_t)1;
+	if (graph->max_length == 0)
+		return false;
+
+	// group the inputs of each node together
+	graph->inputs = realloc(graph->inputs, MAX(graph->num_edges, 1) * sizeof(int));
+	for (int k=0; k<n; k++) nodes[k].count = 0;
+	for (int e=0; e<graph->num_edges; e++) nodes[graph->edges[e].to].count++;
+	for (int k=0, first=0; k<n; k++) {
+		nodes[k].first = first;
+		first += nodes[k].count;
+		nodes[k].count = 0;
+	}
+	for (int e=0; e<graph->num_edges; e++) {
+		graph_node* to = &nodes[graph->edges[e].to];
+		graph->inputs[to->first + to->count++] = graph->edges[e].from;
+	}
+
+	// sort the nodes, so each one comes after all of its inputs
+	int* waiting = malloc(n * sizeof(int));  // inputs not yet processed
+	int* pos = malloc(n * sizeof(int));      // position of each node in the order
+	int* last_use = malloc(n * sizeof(int)); // position where each output is last read
+	graph->order = realloc(graph->order, n * sizeof(int));
+	int sorted = 0;
+	for (int k=0; k<n; k++) {
+		waiting[k] = nodes[k].count;
+		if (waiting[k] == 0) graph->order[sorted++] = k;
+	}
+	for (int i=0; i<sorted; i++) {
+		int k = graph->order[i];
+		pos[k] = i;
+		for (int e=0; e<graph->num_edges; e++) {
+			int to = graph->edges[e].to;
+			if (graph->edges[e].from == k && --waiting[to] == 0)
+				graph->order[sorted++] = to;
+		}
+	}
+	if (sorted < n) {
+		// there's a loop
+		free(waiting);
+		free(pos);
+		free(last_use);
+		return false;
+	}
+
+	for (int k=0; k<n; k++) last_use[k] = pos[k];
+	for (int e=0; e<graph->num_edges; e++) {
+		int from = graph->edges[e].from;
+		last_use[from] = MAX(last_use[from], pos[graph->edges[e].to]);
+	}
+	last_use[NOCTA_GRAPH_OUTPUT] = n; // read after everything else
+
+	// assign buffers, reusing them once their last reader is done
+	bool use_float = graph->context->backend == NOCTA_BACKEND_FLOAT;
+	int* free_slots = waiting; // no longer needed for sorting
+	int num_free = 0;
+	graph->num_slots = 0;
+
+	for (int i=0; i<n; i++) {
+		int k = graph->order[i];
+		graph_node* node = &nodes[k];
+		int* in = &graph->inputs[node->first];
+
+		node->slot = NO_SLOT;
+		if (k == NOCTA_GRAPH_INPUT && !use_float) {
+			node->slot = HOST_SLOT; // already holds the input
+		} else {
+			// take over an input which isn't needed afterwards
+			for (int j=0; j<node->count; j++) {
+				if (last_use[in[j]] == i) {
+					int first = in[0];
+					in[0] = in[j];
+					in[j] = first;
+					node->slot = nodes[in[0]].slot;
+					break;
+				}
+			}
+		}
+		if (node->slot == NO_SLOT) {
+			node->slot = num_free ? free_slots[--num_free] : graph->num_slots++;
+		}
+
+		// release the other inputs that are done with
+		for (int j=0; j<node->count; j++) {
+			graph_node* input = &nodes[in[j]];
+			if (last_use[in[j]] == i && input->slot != node->slot)
+				free_slots[num_free++] = input->slot;
+		}
+		// and outputs that nothing reads
+		if (last_use[k] == i)
+			free_slots[num_free++] = node->slot;
+	}
+
+	free(waiting);
+	free(pos);
+	free(last_use);
+
+	if (graph->num_slots)
+		reserve_pool(graph->context, graph->num_slots, graph->max_length * sample_size(graph->context));
+	graph->built = true;
+	return true;
+}
+
+static bool is_gainer(nocta_unit* unit) {
+	return unit && strcmp(unit->name, "gainer") == 0;
+}
+
+// the node that reads `k` and nothing else, if nothing else reads `k`
+static int chain_next(nocta_graph* graph, int k) {
+	int next = -1;
+	for (int e=0; e<graph->num_edges; e++) {
+		if (graph->edges[e].from != k) continue;
+		if (next >= 0) return -1;
+		next = graph->edges[e].to;
+	}
+	if (next < 0 || graph->nodes[next].count != 1)
+		return -1;
+	return next;
+}
+
+bool nocta_graph_compile(nocta_graph* graph, size_t max_length) {
+	if (!nocta_graph_build(graph, max_length))
+		return false;
+
+	int n = graph->num_nodes;
+	graph_node* nodes = graph->nodes;
+	graph->groups = realloc(graph->groups, n * sizeof(fused_group));
+	graph->fused = realloc(graph->fused, n * sizeof(nocta_unit*));
+	graph->gains = realloc(graph->gains, n * 2 * sizeof(int));
+
+	for (int i=0; i<n; i++) {
+		int k = graph->order[i];
+		if (!is_gainer(nodes[k].unit) || nodes[k].group != NO_GROUP)
+			continue;
+
+		// follow the chain through the gainers (which are all processed in
+		// place, as nothing else reads them)
+		int first = graph->num_fused;
+		int last = k;
+		graph->fused[graph->num_fused++] = nodes[k].unit;
+		int next = chain_next(graph, k);
+		while (next >= 0 && is_gainer(nodes[next].unit)) {
+			nodes[last].group = FUSED;
+			last = next;
+			graph->fused[graph->num_fused++] = nodes[next].unit;
+			next = chain_next(graph, next);
+		}
+
+		nocta_unit* filter = next >= 0 ? nodes[next].unit : NULL;
+		void (*fold)(nocta_unit*, int) = NULL;
+		if (filter && strcmp(filter->name, "bqfilter") == 0) fold = bqfilter_fold;
+		if (filter && strcmp(filter->name, "svfilter") == 0) fold = svfilter_fold;
+
+		int count = graph->num_fused - first;
+		if (count == 1 && !fold) {
+			// nothing to fuse it with
+			graph->num_fused--;
+			continue;
+		}
+		for (int j=first; j<graph->num_fused; j++) {
+			graph->gains[j*2] = graph->gains[j*2+1] = -1; // worked out on the first block
+		}
+		nodes[last].group = graph->num_groups;
+		graph->groups[graph->num_groups++] = (fused_group){
+			.first = first,
+			.count = count,
+			.filter = fold ? filter : NULL,
+			.fold = fold,
+			.folded = 65536
+		};
+	}
+	return true;
+}
+
+// buffer operations for either backend:
+
+static void copy_block(bool use_float, void* dest, const void* src, size_t length) {
+	memcpy(dest, src, length * (use_float ? sizeof(float) : sizeof(int16_t)));
+}
+
+static void clear_block(bool use_float, void* dest, size_t length) {
+	memset(dest, 0, length * (use_float ? sizeof(float) : sizeof(int16_t)));
+}
+
+static void mix_block(bool use_float, void* dest, const void* src, size_t length) {
+	if (use_float) {
+		float* d = dest;
+		const float* s = src;
+		for (size_t i=0; i<length; i++) d[i] += s[i];
+	} else {
+		int16_t* d = dest;
+		const int16_t* s = src;
+		for (size_t i=0; i<length; i++) d[i] = clip(d[i] + s[i]);
+	}
+}
+
+// check a group's gainers can be fused for the next `frames` frames, and
+// work out their gain again if any of them have changed
+static bool update_group(nocta_graph* graph, fused_group* group, size_t frames) {
+	nocta_unit** units = &graph->fused[group->first];
+	int* gains = &graph->gains[group->first * 2];
+	// check them all before touching the gains seen, so none is taken in
+	// without the combined gain being worked out again
+	for (int i=0; i<group->count; i++) {
+		nocta_unit* unit = units[i];
+		int l, r;
+		if (unit->automation || unit->pending_automation || unit->pending_preset || events_due(unit, frames))
+			return false;
+		if (!gainer_gain(unit, &l, &r))
+			return false;
+	}
+
+	bool changed = false;
+	for (int i=0; i<group->count; i++) {
+		int l, r;
+		gainer_gain(units[i], &l, &r);
+		if (gains[i*2] != l || gains[i*2+1] != r) {
+			gains[i*2] = l;
+			gains[i*2+1] = r;
+			changed = true;
+		}
+	}
+	if (!changed)
+		return true;
+
+	int64_t l = 65536, r = 65536;
+	float lf = 1, rf = 1;
+	for (int i=0; i<group->count; i++) {
+		l = MIN(l * gains[i*2] >> 16, MAX_GAIN);
+		r = MIN(r * gains[i*2+1] >> 16, MAX_GAIN);
+		lf *= gains[i*2] * (1.0f / 65536);
+		rf *= gains[i*2+1] * (1.0f / 65536);
+	}
+	group->gain_l = l;
+	group->gain_r = r;
+	group->gain_lf = lf;
+	group->gain_rf = rf;
+	return true;
+}
+
+static void set_fold(fused_group* group, int gain) {
+	if (group->filter && group->folded != gain) {
+		group->fold(group->filter, gain);
+		group->folded = gain;
+	}
+}
+
+static void process_group(nocta_graph* graph, fused_group* group, void* buffer, size_t length) {
+	bool use_float = graph->context->backend == NOCTA_BACKEND_FLOAT;
+	nocta_unit** units = &graph->fused[group->first];
+
+	if (!update_group(graph, group, length / 2)) {
+		set_fold(group, 65536);
+		for (int i=0; i<group->count; i++) {
+			if (use_float)
+				nocta_process_float(units[i], buffer, length);
+			else
+				nocta_process_buffer(units[i], buffer, length);
+		}
+		return;
+	}
+	for (int i=0; i<group->count; i++) units[i]->time += length / 2;
+
+	if (group->filter && group->gain_l == group->gain_r && group->gain_l <= MAX_FOLD) {
+		set_fold(group, group->gain_l);
+		return;
+	}
+	set_fold(group, 65536);
+
+	if (use_float) {
+		float* f = buffer;
+		for (size_t i=0; i<length; i+=2) {
+			f[i] *= group->gain_lf;
+			f[i+1] *= group->gain_rf;
+		}
+	} else {
+		int16_t* b = buffer;
+		int64_t l = group->gain_l, r = group->gain_r;
+		for (size_t i=0; i<length; i+=2) {
+			b[i] = CLAMP(b[i] * l >> 16, INT16_MIN, INT16_MAX);
+			b[i+1] = CLAMP(b[i+1] * r >> 16, INT16_MIN, INT16_MAX);
+		}
+	}
+}
+
+static void process_block(nocta_graph* graph, int16_t* host, size_t length) {
+	bool use_float = graph->context->backend == NOCTA_BACKEND_FLOAT;
+	graph_node* nodes = graph->nodes;
+
+	for (int i=0; i<graph->num_nodes; i++) {
+		int k = graph->order[i];
+		graph_node* node = &nodes[k];
+		void* out = slot_buffer(graph, host, node->slot);
+
+		if (k == NOCTA_GRAPH_INPUT) {
+			if (use_float) {
+				float* f = out;
+				for (size_t j=0; j<length; j++) f[j] = int16_to_float(host[j]);
+			}
+			continue;
+		}
+
+		// sum the inputs (the first one may already be in place)
+		int* in = &graph->inputs[node->first];
+		if (node->count == 0) {
+			clear_block(use_float, out, length);
+		} else if (nodes[in[0]].slot != node->slot) {
+			copy_block(use_float, out, slot_buffer(graph, host, nodes[in[0]].slot), length);
+		}
+		for (int j=1; j<node->count; j++) {
+			mix_block(use_float, out, slot_buffer(graph, host, nodes[in[j]].slot), length);
+		}
+
+		if (node->group == FUSED)
+			continue;
+		if (node->group != NO_GROUP) {
+			process_group(graph, &graph->groups[node->group], out, length);
+		} else if (node->unit) {
+			if (use_float)
+				nocta_process_float(node->unit, out, length);
+			else
+				nocta_process_buffer(node->unit, out, length);
+		}
+	}
+
+	int slot = nodes[NOCTA_GRAPH_OUTPUT].slot;
+	if (use_float) {
+		float* f = slot_buffer(graph, host, slot);
+		for (size_t j=0; j<length; j++) host[j] = float_to_int16(f[j]);
+	} else if (slot != HOST_SLOT) {
+		copy_block(false, host, slot_buffer(graph, host, slot), length);
+	}
+}
+
+void nocta_graph_process(nocta_graph* graph, int16_t* buffer, size_t length) {
+	if (!graph->built) return;
+	RT_ENTER(graph->context->sample_rate, length / 2);
+	while (length > 0) {
+		size_t n = MIN(length, graph->max_length);
+		process_block(graph, buffer, n);
+		buffer += n;
+		length -= n;
+	}
+	RT_LEAVE();
+}
@@ -0,0 +1,173 @@
+#include "common.h"
+
+// Level meter.
+// Passes the sound through unchanged, measuring the peak and mean square of
+// each channel. Every `period`, the levels are published with a sequence
+// lock: the sequence number is odd while they're being written, so a reader
+// on another thread retries until it gets a consistent copy, without the
+// audio thread ever waiting.
+
+#define LANES 16   // samples measured side by side (8 frames)
+
+static int get_period(nocta_unit* self);
+static void set_period(nocta_unit* self, int period);
+
+static nocta_param meter_params[] = {
+	{"period", 0, 1000, get_period, set_period}
+};
+
+typedef struct {
+	// parameters and derived values (captured by presets):
+	int period;
+	uint32_t period_frames;
+	int sample_rate;
+
+	// state:
+	int peak[2];
+	uint64_t sum[2];         // sum of squares
+	uint32_t frames;         // frames measured since the last snapshot
+	uint32_t clips;
+
+	// published levels (only accessed atomically):
+	uint32_t seq;
+	uint32_t out_peak[2];
+	uint32_t out_square[2];  // mean square
+	uint32_t out_clips;
+	uint32_t out_count;
+} meter_data;
+
+static void meter_measure(meter_data* data, const int16_t* buffer, size_t length);
+static int meter_l(nocta_unit* self, int x);
+static int meter_r(nocta_unit* self, int x);
+static void meter_buffer(nocta_unit* self, int16_t* buffer, size_t length);
+
+nocta_unit* nocta_meter(nocta_context* context) {
+
+	nocta_unit* self = nocta_create(
+		.context = context,
+		.name = "meter",
+		.data = ialloc(meter_data, .sample_rate = context->sample_rate),
+		.process_l = meter_l,
+		.process_r = meter_r,
+		.process_buffer = meter_buffer,
+		.params = meter_params,
+		.num_params = NOCTA_METER_NUM_PARAMS,
+		.preset_size = offsetof(meter_data, peak)
+	);
+
+	set_period(self, 20);
+	preset_snapshot(self);
+	return self;
+}
+
+void nocta_meter_read(nocta_unit* self, nocta_meter_levels* levels) {
+	meter_data* data = self->data;
+	uint32_t seq;
+	uint32_t peak[2], square[2], clips, count;
+	do {
+		seq = __atomic_load_n(&data->seq, __ATOMIC_ACQUIRE);
+		for (int ch=0; ch<2; ch++) {
+			peak[ch] = __atomic_load_n(&data->out_peak[ch], __ATOMIC_RELAXED);
+			square[ch] = __atomic_load_n(&data->out_square[ch], __ATOMIC_RELAXED);
+		}
+		clips = __atomic_load_n(&data->out_clips, __ATOMIC_RELAXED);
+		count = __atomic_load_n(&data->out_count, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	} while ((seq & 1) || seq != __atomic_load_n(&data->seq, __ATOMIC_RELAXED));
+
+	// the square root is left to the reader, to keep it off the audio thread
+	levels->peak_l = peak[0];
+	levels->peak_r = peak[1];
+	levels->rms_l = sqrt(square[0]);
+	levels->rms_r = sqrt(square[1]);
+	levels->clips = clips;
+	levels->count = count;
+}
+
+static void publish(meter_data* data) {
+	uint32_t seq = data->seq;
+	__atomic_store_n(&data->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	for (int ch=0; ch<2; ch++) {
+		__atomic_store_n(&data->out_peak[ch], data->peak[ch], __ATOMIC_RELAXED);
+		__atomic_store_n(&data->out_square[ch], data->sum[ch] / data->frames, __ATOMIC_RELAXED);
+	}
+	__atomic_store_n(&data->out_clips, data->clips, __ATOMIC_RELAXED);
+	__atomic_store_n(&data->out_count, data->out_count + 1, __ATOMIC_RELAXED);
+	__atomic_store_n(&data->seq, seq + 2, __ATOMIC_RELEASE);
+
+	data->peak[0] = data->peak[1] = 0;
+	data->sum[0] = data->sum[1] = 0;
+	data->frames = 0;
+}
+
+static void meter_measure(meter_data* data, const int16_t* buffer, size_t length) {
+	int peak[LANES] = {0};
+	int64_t sum[LANES] = {0};
+	uint32_t clips = 0;
+
+	// even lanes are the left channel, odd lanes the right
+	size_t i = 0;
+	for (; i + LANES <= length; i += LANES) {
+		for (int j=0; j<LANES; j++) {
+			int x = buffer[i+j];
+			int a = abs(x);
+			peak[j] = MAX(peak[j], a);
+			sum[j] += x * x;
+			clips += a >= INT16_MAX;
+		}
+	}
+	for (int j=0; i<length; i++, j++) {
+		int x = buffer[i];
+		peak[j] = MAX(peak[j], abs(x));
+		sum[j] += x * x;
+		clips += abs(x) >= INT16_MAX;
+	}
+
+	for (int j=0; j<LANES; j++) {
+		data->peak[j & 1] = MAX(data->peak[j & 1], peak[j]);
+		data->sum[j & 1] += sum[j];
+	}
+	data->clips += clips;
+	data->frames += length / 2;
+	if (data->frames >= data->period_frames)
+		publish(data);
+}
+
+static int meter_l(nocta_unit* self, int x) {
+	meter_data* data = self->data;
+	data->peak[0] = MAX(data->peak[0], abs(x));
+	data->sum[0] += x * x;
+	data->clips += abs(x) >= INT16_MAX;
+	return x;
+}
+
+// a frame is complete once the right channel has been measured
+static int meter_r(nocta_unit* self, int x) {
+	meter_data* data = self->data;
+	data->peak[1] = MAX(data->peak[1], abs(x));
+	data->sum[1] += x * x;
+	data->clips += abs(x) >= INT16_MAX;
+	if (++data->frames >= MAX(data->period_frames, 1))
+		publish(data);
+	return x;
+}
+
+static void meter_buffer(nocta_unit* self, int16_t* buffer, size_t length) {
+	meter_data* data = self->data;
+	if (length >= 2)
+		meter_measure(data, buffer, length);
+}
+
+
+// getters and setters:
+
+static int get_period(nocta_unit* self) {
+	meter_data* data = self->data;
+	return data->period;
+}
+static void set_period(nocta_unit* self, int period) {
+	meter_data* data = self->data;
+	data->period = CLAMP(period, 0, 1000);
+	data->period_frames = data->period * data->sample_rate / 1000;
+}
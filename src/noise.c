@@ -0,0 +1,163 @@
+#include "common.h"
+#include "random.h"
+
+// Noise generator.
+// White noise comes from LANES independent xorshift generators, which are
+// all stepped at once to fill a small buffer. Pink noise is white noise
+// through Paul Kellet's 3-pole "economy" filter, and brown noise is white
+// noise through a leaky integrator.
+
+#define LANES 8
+
+static int get_vol(nocta_unit* self);
+static void set_vol(nocta_unit* self, int vol);
+static int get_color(nocta_unit* self);
+static void set_color(nocta_unit* self, int color);
+
+static nocta_param noise_params[] = {
+	{"vol", 0, 255, get_vol, set_vol},
+	{"color", 0, NOCTA_NOISE_NUM_COLORS-1, get_color, set_color}
+};
+
+typedef struct {
+	int b0, b1, b2;   // pink filter state
+	int brown;        // brown integrator state
+} noise_channel;
+
+typedef struct {
+	uint8_t vol;
+	int color;
+
+	// state (everything above is captured by presets):
+	uint32_t lanes[LANES];
+	int white[LANES];  // buffered white noise, in 3:13
+	int next;          // index of the next value in `white`
+	noise_channel l, r;
+} noise_data;
+
+static int noise_l(nocta_unit* self, int x);
+static int noise_r(nocta_unit* self, int x);
+static void noise_buffer(nocta_unit* self, int16_t* buffer, size_t length);
+
+static uint32_t instances; // gives each new unit a different default seed
+
+nocta_unit* nocta_noise(nocta_context* context) {
+
+	nocta_unit* self = nocta_create(
+		.context = context,
+		.name = "noise",
+		.data = ialloc(noise_data,
+			.vol = 128,
+			.color = NOCTA_NOISE_WHITE
+		),
+		.process_l = noise_l,
+		.process_r = noise_r,
+		.process_buffer = noise_buffer,
+		.params = noise_params,
+		.num_params = NOCTA_NOISE_NUM_PARAMS,
+		.preset_size = offsetof(noise_data, lanes)
+	);
+
+	nocta_noise_seed(self, __atomic_fetch_add(&instances, 1, __ATOMIC_RELAXED));
+	preset_snapshot(self);
+	return self;
+}
+
+void nocta_noise_seed(nocta_unit* self, uint32_t seed) {
+	noise_data* data = self->data;
+	for (int k=0; k<LANES; k++) {
+		data->lanes[k] = hash_seed(seed * LANES + k);
+	}
+	data->next = LANES;
+	data->l = data->r = (noise_channel){ 0 };
+}
+
+// step every generator at once
+static void refill(noise_data* data) {
+	for (int k=0; k<LANES; k++) {
+		data->white[k] = random_to_fix(xorshift32(&data->lanes[k]));
+	}
+	data->next = 0;
+}
+
+static inline int next_white(noise_data* data) {
+	if (data->next == LANES) refill(data);
+	return data->white[data->next++];
+}
+
+static inline int noise_run(noise_data* data, noise_channel* c, int in) {
+	int white = next_white(data);
+	int out;
+	switch (data->color) {
+		case NOCTA_NOISE_PINK:
+			// b = b*pole + white*gain, with everything in 0:15
+			c->b0 += (white * 3246 - c->b0 * (32768 - 32691)) >> 15;
+			c->b1 += (white * 9716 - c->b1 * (32768 - 31556)) >> 15;
+			c->b2 += (white * 34494 - c->b2 * (32768 - 18678)) >> 15;
+			out = (c->b0 + c->b1 + c->b2 + (white * 6056 >> 15)) >> 2;
+			break;
+		case NOCTA_NOISE_BROWN:
+			c->brown = (c->brown * 1019 >> 10) + (white >> 3);
+			out = c->brown;
+			break;
+		default:
+			out = white;
+			break;
+	}
+	return in + fix_to_int(out * u8_to_fix(data->vol));
+}
+
+static int noise_l(nocta_unit* self, int x) {
+	noise_data* data = self->data;
+	return noise_run(data, &data->l, x);
+}
+
+static int noise_r(nocta_unit* self, int x) {
+	noise_data* data = self->data;
+	return noise_run(data, &data->r, x);
+}
+
+static void noise_buffer(nocta_unit* self, int16_t* buffer, size_t length) {
+	noise_data* data = self->data;
+
+	// fast path for white noise: fill whole groups of samples at a time
+	if (data->color == NOCTA_NOISE_WHITE && data->next == LANES) {
+		int amp = u8_to_fix(data->vol);
+		while (length >= LANES) {
+			refill(data);
+			for (int k=0; k<LANES; k++) {
+				buffer[k] = clip(buffer[k] + fix_to_int(data->white[k] * amp));
+			}
+			data->next = LANES;
+			buffer += LANES;
+			length -= LANES;
+		}
+	}
+
+	for (size_t i=0; i<length/2; i++) {
+		buffer[0] = clip(noise_run(data, &data->l, buffer[0]));
+		buffer[1] = clip(noise_run(data, &data->r, buffer[1]));
+		buffer += 2;
+	}
+}
+
+
+// getters and setters
+
+static int get_vol(nocta_unit* self) {
+	noise_data* data = self->data;
+	return data->vol;
+}
+static void set_vol(nocta_unit* self, int vol) {
+	noise_data* data = self->data;
+	data->vol = vol;
+}
+
+static int get_color(nocta_unit* self) {
+	noise_data* data = self->data;
+	return data->color;
+}
+static void set_color(nocta_unit* self, int color) {
+	noise_data* data = self->data;
+	data->color = color;
+}
@@ -1,4 +1,6 @@
 #include "common.h"
+#include "random.h"
+#include "utils.h"
 
 static int get_active(nocta_unit* self);
 static void set_active(nocta_unit* self, int active);
@@ -8,63 +10,112 @@ static int get_freq(nocta_unit* self);
 static void set_freq(nocta_unit* self, int freq);
 static int get_wave(nocta_unit* self);
 static void set_wave(nocta_unit* self, int wave);
+static int get_note(nocta_unit* self);
+static void set_note(nocta_unit* self, int note);
+static int get_fine(nocta_unit* self);
+static void set_fine(nocta_unit* self, int fine);
 
 static nocta_param osc_params[] = {
 	{"active", 0, 1, get_active, set_active},
 	{"vol", 0, 255, get_vol, set_vol},
 	{"freq", 50, 20000, get_freq, set_freq},
-	{"wave", 0, NOCTA_NUM_WAVES-1, get_wave, set_wave}
+	{"wave", 0, NOCTA_NUM_WAVES-1, get_wave, set_wave},
+	{"note", 0, 127, get_note, set_note},
+	{"fine", -100, 100, get_fine, set_fine}
 };
 
 struct osc_data;
 typedef struct osc_data osc_data;
-typedef int (*wave_cb)(int);
+typedef int (*wave_cb)(osc_data* osc);
 
 struct osc_data {
 	bool active;
 	uint8_t vol;
 	int freq;
 	int wave;
+	int note, fine;
 	wave_cb callback;
-	int pos;
+	uint32_t phase;      // position in the current cycle, where 2^32 = one cycle
+	uint32_t phase_inc;  // how much to advance the phase each sample
+	uint32_t rng;        // random state for the noise wave
 };
 
-static int saw(int t);
-static int sine(int t);
-static int square(int t);
-static int triangle(int t);
-static int noise(int t);
+static int saw(osc_data* osc);
+static int sine(osc_data* osc);
+static int square(osc_data* osc);
+static int triangle(osc_data* osc);
+static int noise(osc_data* osc);
 
 static wave_cb waves[] = { saw, sine, square, triangle, noise };
 
 static int osc_process_l(nocta_unit* self, int in);
 static int osc_process_r(nocta_unit* self, int in);
+static void osc_process_buffer(nocta_unit* self, int16_t* buffer, size_t length);
+static void osc_process_float(nocta_unit* self, float* buffer, size_t length);
+static void osc_note(nocta_unit* self, int note, bool on);
+
+static uint32_t instances; // gives each new unit a different default seed
 
 nocta_unit* nocta_osc(nocta_context* context) {
 	
-	return nocta_create(
+	build_note_table(context);
+	
+	nocta_unit* self = nocta_create(
 		.context = context,
 		.name = "osc",
 		.data = ialloc(osc_data, 
 			.active = false,
 			.vol = 128,
-			.freq = 440,
 			.wave = 0,
 			.callback = waves[0],
-			.pos = 0
+			.phase = 0
 		),
 		.process_l = osc_process_l,
 		.process_r = osc_process_r,
+		.process_buffer = osc_process_buffer,
+		.process_float = osc_process_float,
+		.note = osc_note,
 		.params = osc_params,
 		.num_params = NOCTA_OSC_NUM_PARAMS
 	);
+	
+	set_note(self, 69); // A4 (440 Hz)
+	nocta_osc_seed(self, __atomic_fetch_add(&instances, 1, __ATOMIC_RELAXED));
+	return self;
+}
+
+void nocta_osc_seed(nocta_unit* self, uint32_t seed) {
+	osc_data* data = self->data;
+	data->rng = hash_seed(seed);
+}
+
+void nocta_osc_on(nocta_unit* self) {
+	set_active(self, true);
+}
+
+void nocta_osc_off(nocta_unit* self) {
+	set_active(self, false);
+}
+
+void nocta_osc_note(nocta_unit* self, int note) {
+	set_note(self, note);
+	set_active(self, true);
+}
+
+// only one note plays at a time, so any note off stops it
+static void osc_note(nocta_unit* self, int note, bool on) {
+	if (on)
+		nocta_osc_note(self, note);
+	else
+		nocta_osc_off(self);
 }
 
 
 static int osc_process_l(nocta_unit* self, int x) {
 	osc_data* data = self->data;
-	int out = data->callback(data->pos);
-	data->pos += normalize_hz(data->freq, self->context->sample_rate);
+	if (!data->active) return x;
+	int out = data->callback(data);
+	data->phase += data->phase_inc;
 	int amp = u8_to_fix(data->vol);
 	return fix_to_int((x + out) * amp);
 }
@@ -72,26 +123,64 @@ static int osc_process_l(nocta_unit* self, int x) {
 // doesn't advance the phase of the oscillator
 static int osc_process_r(nocta_unit* self, int x) {
 	osc_data* data = self->data;
-	int out  = data->callback(data->pos);
+	if (!data->active) return x;
+	int out  = data->callback(data);
 	int amp = u8_to_fix(data->vol);
 	return fix_to_int((x + out) * amp);
 }
 
+static void osc_process_buffer(nocta_unit* self, int16_t* buffer, size_t length) {
+	osc_data* data = self->data;
+	if (!data->active) return;
+	int amp = u8_to_fix(data->vol);
+	wave_cb callback = data->callback;
+	for (size_t i=0; i<length/2; i++) {
+		int out = callback(data);
+		buffer[0] = clip(fix_to_int((buffer[0] + out) * amp));
+		buffer[1] = clip(fix_to_int((buffer[1] + callback(data)) * amp));
+		data->phase += data->phase_inc;
+		buffer += 2;
+	}
+}
+
+// the waves are still generated from the integer phase, and scaled so they
+// match the fixed point output (full scale = 1/4 of the sample range)
+static void osc_process_float(nocta_unit* self, float* buffer, size_t length) {
+	osc_data* data = self->data;
+	if (!data->active) return;
+	float amp = data->vol / 256.0f;
+	wave_cb callback = data->callback;
+	for (size_t i=0; i<length; i+=2) {
+		float out = int16_to_float(callback(data));
+		buffer[i] = (buffer[i] + out) * amp;
+		buffer[i+1] = (buffer[i+1] + int16_to_float(callback(data))) * amp;
+		data->phase += data->phase_inc;
+	}
+}
+
+
+// position within the current cycle, in 3:13 from 0 to 1.0
+static inline int cycle_pos(osc_data* osc) {
+	return osc->phase >> (32 - FIX_PT);
+}
 
-static int saw(int t) {
-	return (t % FIX_1 - FIX_1/2) * 2;
+static int saw(osc_data* osc) {
+	int t = cycle_pos(osc);
+	return (t - FIX_1/2) * 2;
 }
-static int sine(int t) {
+static int sine(osc_data* osc) {
 	return 0;
 }
-static int square(int t) {
-	return (t % FIX_1 > FIX_1/2) ? FIX_1 : -FIX_1;
+static int square(osc_data* osc) {
+	int t = cycle_pos(osc);
+	return (t > FIX_1/2) ? FIX_1 : -FIX_1;
 }
-static int triangle(int t) {
-	return (abs(t % FIX_1 - FIX_1/2) - FIX_1/4) * 4;
+static int triangle(osc_data* osc) {
+	int t = cycle_pos(osc);
+	return (abs(t - FIX_1/2) - FIX_1/4) * 4;
 }
-static int noise(int t) {
-	return rand();
+static int noise(osc_data* osc) {
+	return random_to_fix(xorshift32(&osc->rng));
 }
 
 
@@ -123,6 +212,7 @@ static int get_freq(nocta_unit* self) {
 static void set_freq(nocta_unit* self, int freq) {
 	osc_data* data = self->data;
 	data->freq = freq;
+	data->phase_inc = ((uint64_t)freq << 32) / self->context->sample_rate;
 }
 
 static int get_wave(nocta_unit* self) {
@@ -134,3 +224,30 @@ static void set_wave(nocta_unit* self, int wave) {
 	data->wave = wave;
 	data->callback = waves[wave];
 }
+
+static int get_note(nocta_unit* self) {
+	osc_data* data = self->data;
+	return data->note;
+}
+// the frequency a phase increment plays at, so notes don't need libm
+static inline int inc_to_freq(nocta_unit* self, uint32_t phase_inc) {
+	return ((uint64_t)phase_inc * self->context->sample_rate + (1u << 31)) >> 32;
+}
+
+static void set_note(nocta_unit* self, int note) {
+	osc_data* data = self->data;
+	data->note = CLAMP(note, 0, 127);
+	data->phase_inc = note_to_phase_inc(self->context, data->note, data->fine);
+	data->freq = inc_to_freq(self, data->phase_inc);
+}
+
+static int get_fine(nocta_unit* self) {
+	osc_data* data = self->data;
+	return data->fine;
+}
+static void set_fine(nocta_unit* self, int fine) {
+	osc_data* data = self->data;
+	data->fine = CLAMP(fine, -100, 100);
+	data->phase_inc = note_to_phase_inc(self->context, data->note, data->fine);
+	data->freq = inc_to_freq(self, data->phase_inc);
+}
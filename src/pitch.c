@@ -0,0 +1,278 @@
+#include "common.h"
+#include "delayline.h"
+#include "tables.h"
+#include "utils.h"
+
+// Pitch shifter (WSOLA).
+// Two grains read the input back through a delay line, half a grain apart,
+// each under a Hann window from the context's tables, so their windows
+// always add up to 1.0. A grain's delay changes by (1 - ratio) every frame,
+// which plays it back at the shifted pitch. When a grain ends, the next one
+// starts where the input best matches what the other grain is about to play
+// (the peak of their cross-correlation), so the two don't cancel out where
+// they overlap. The correlation runs on a mono copy of the input, copied out
+// to linear buffers first, and is worked out for LANES candidates at a time
+// so the compiler can vectorize it. A splice costs the same every time and
+// there is one every half grain, so the cost of a block is bounded.
+
+#define MIN_GRAIN 10     // grain length, in milliseconds
+#define MAX_GRAIN 100
+#define SEARCH_MS 5      // how far to search for a splice, and how much to compare
+#define MAX_SEARCH 512   // (in samples)
+#define LANES 8
+#define WINDOW_END (1u << (HANN_BITS + 16))  // end of a grain, as a window position
+
+static int get_dry(nocta_unit* self);
+static void set_dry(nocta_unit* self, int dry);
+static int get_wet(nocta_unit* self);
+static void set_wet(nocta_unit* self, int wet);
+static int get_shift(nocta_unit* self);
+static void set_shift(nocta_unit* self, int shift);
+static int get_grain(nocta_unit* self);
+static void set_grain(nocta_unit* self, int grain);
+
+static nocta_param pitch_params[] = {
+	{"dry", 0, 255, get_dry, set_dry},
+	{"wet", 0, 255, get_wet, set_wet},
+	{"shift", -1200, 1200, get_shift, set_shift},
+	{"grain", MIN_GRAIN, MAX_GRAIN, get_grain, set_grain}
+};
+
+typedef struct {
+	int delay;        // in samples (16:16)
+	uint32_t phase;   // position in the window (16:16 table entries)
+} pitch_grain;
+
+typedef struct {
+	// parameters and derived values (captured by presets):
+	uint8_t dry, wet;
+	int shift;
+	int grain;
+	int ratio;        // playback speed (16:16)
+	int drift;        // change in delay each frame (16:16)
+	int base;         // shortest delay a grain can start at
+	uint32_t window_step;
+	int search;       // samples searched and compared at each splice
+	int max_delay;
+	int sample_rate;
+
+	// state:
+	const int16_t* window;
+	delay_line l, r, mono;
+	pitch_grain grains[2];
+	int in_l;         // left input of the current frame, for process_r
+} pitch_data;
+
+static int pitch_l(nocta_unit* self, int x);
+static int pitch_r(nocta_unit* self, int x);
+static void pitch_buffer(nocta_unit* self, int16_t* buffer, size_t length);
+static void pitch_free(nocta_unit* self);
+
+nocta_unit* nocta_pitch(nocta_context* context) {
+	build_hann_table(context);
+
+	int search = context->sample_rate * SEARCH_MS / 1000;
+	search = MIN((search + LANES-1) & ~(LANES-1), MAX_SEARCH);
+	int max_grain = MAX_GRAIN * context->sample_rate / 1000;
+	// the furthest back a grain can get: the start of the search at an
+	// octave up, the whole search, and half a grain of drifting at an octave down
+	int max_delay = search + 2 + max_grain + search + max_grain / 2 + 2;
+
+	pitch_data* data = ialloc(pitch_data,
+		.search = search,
+		.max_delay = max_delay,
+		.sample_rate = context->sample_rate,
+		.window = get_tables(context)->hann,
+		.l = delay_line_create(max_delay + 2),
+		.r = delay_line_create(max_delay + 2),
+		.mono = delay_line_create(max_delay + 2)
+	);
+
+	nocta_unit* self = nocta_create(
+		.context = context,
+		.name = "pitch",
+		.data = data,
+		.process_l = pitch_l,
+		.process_r = pitch_r,
+		.process_buffer = pitch_buffer,
+		.free = pitch_free,
+		.preset_size = offsetof(pitch_data, window),
+		.params = pitch_params,
+		.num_params = NOCTA_PITCH_NUM_PARAMS
+	);
+
+	set_dry(self, 0);
+	set_wet(self, 255);
+	set_grain(self, 40);
+	set_shift(self, 0);
+	data->grains[0] = (pitch_grain){ data->base << 16, 0 };
+	data->grains[1] = (pitch_grain){ data->base << 16, WINDOW_END / 2 };
+	preset_snapshot(self);
+	return self;
+}
+
+static void pitch_free(nocta_unit* self) {
+	pitch_data* data = self->data;
+	delay_line_free(&data->l);
+	delay_line_free(&data->r);
+	delay_line_free(&data->mono);
+}
+
+// the candidate (out of `n`) whose next `n` samples correlate best with `target`
+static int best_splice(const int16_t* candidates, const int16_t* target, int n) {
+	int best = 0;
+	int best_sum = INT32_MIN;
+	for (int c=0; c<n; c+=LANES) {
+		int32_t sum[LANES] = {0};
+		for (int j=0; j<n; j++) {
+			for (int k=0; k<LANES; k++)
+				sum[k] += candidates[c+k+j] * target[j];
+		}
+		for (int k=0; k<LANES; k++) {
+			if (sum[k] > best_sum) {
+				best_sum = sum[k];
+				best = c + k;
+			}
+		}
+	}
+	return best;
+}
+
+// start a grain again, at the splice point that best follows the other one
+static void splice(pitch_data* data, pitch_grain* grain, const pitch_grain* other) {
+	int n = data->search;
+	// samples are scaled down to 11 bits, so the sums fit in 32 bits
+	int16_t target[MAX_SEARCH];
+	int16_t candidates[MAX_SEARCH * 2];
+
+	// what the other grain plays next, at the peak of its window
+	int from = MAX(other->delay >> 16, n);
+	for (int j=0; j<n; j++)
+		target[j] = delay_line_read(&data->mono, (from - j) << 8) >> 5;
+
+	// the delays the new grain could start at, oldest first
+	int oldest = data->base + n - 1;
+	for (int i=0; i<n*2-1; i++)
+		candidates[i] = delay_line_read(&data->mono, (oldest - i) << 8) >> 5;
+
+	grain->delay = (oldest - best_splice(candidates, target, n)) << 16;
+}
+
+// window gain for a position in a grain (3:13)
+static inline int window_at(const int16_t* window, uint32_t phase) {
+	int i = phase >> 16;
+	int frac = phase & 0xffff;
+	return window[i] + ((window[i+1] - window[i]) * frac >> 16);
+}
+
+// the mix of both grains reading a line
+static inline int grains_read(pitch_data* data, delay_line* line) {
+	int y = 0;
+	for (int g=0; g<2; g++) {
+		pitch_grain* grain = &data->grains[g];
+		y += delay_line_read(line, grain->delay >> 8) * window_at(data->window, grain->phase);
+	}
+	return y >> FIX_PT;
+}
+
+// move the grains on a frame, once the input of the frame has been written
+static inline void grains_advance(pitch_data* data) {
+	for (int g=0; g<2; g++) {
+		pitch_grain* grain = &data->grains[g];
+		grain->phase += data->window_step;
+		grain->delay = CLAMP(grain->delay + data->drift, 2 << 16, data->max_delay << 16);
+		if (grain->phase >= WINDOW_END) {
+			grain->phase -= WINDOW_END;
+			splice(data, grain, &data->grains[g ^ 1]);
+		}
+	}
+}
+
+static inline int pitch_mix(pitch_data* data, int in, int wet) {
+	return (in * data->dry >> 8) + (wet * data->wet >> 8);
+}
+
+static int pitch_l(nocta_unit* self, int x) {
+	pitch_data* data = self->data;
+	delay_line_write(&data->l, x);
+	data->in_l = x;
+	return pitch_mix(data, x, grains_read(data, &data->l));
+}
+
+static int pitch_r(nocta_unit* self, int x) {
+	pitch_data* data = self->data;
+	delay_line_write(&data->r, x);
+	delay_line_write(&data->mono, (data->in_l + x) >> 1);
+	int y = pitch_mix(data, x, grains_read(data, &data->r));
+	grains_advance(data);
+	return y;
+}
+
+static void pitch_buffer(nocta_unit* self, int16_t* buffer, size_t length) {
+	pitch_data* data = self->data;
+	int frames = length / 2;
+
+	for (int i=0; i<frames; i++) {
+		int l = buffer[0], r = buffer[1];
+		delay_line_write(&data->l, l);
+		delay_line_write(&data->r, r);
+		delay_line_write(&data->mono, (l + r) >> 1);
+		buffer[0] = clip(pitch_mix(data, l, grains_read(data, &data->l)));
+		buffer[1] = clip(pitch_mix(data, r, grains_read(data, &data->r)));
+		grains_advance(data);
+		buffer += 2;
+	}
+}
+
+
+// getters and setters:
+
+// work out the grain timing from the shift and grain length
+static void update_grains(pitch_data* data) {
+	int frames = data->grain * data->sample_rate / 1000;
+	data->window_step = WINDOW_END / frames;
+	data->drift = 65536 - data->ratio;
+	// shifting up, grains catch up with the input, so they start far enough back
+	// to stay behind it to the end
+	int catch_up = ((int64_t)MAX(data->ratio - 65536, 0) * frames + 65535) >> 16;
+	data->base = data->search + 2 + catch_up;
+}
+
+static int get_dry(nocta_unit* self) {
+	pitch_data* data = self->data;
+	return data->dry;
+}
+static void set_dry(nocta_unit* self, int dry) {
+	pitch_data* data = self->data;
+	data->dry = dry;
+}
+
+static int get_wet(nocta_unit* self) {
+	pitch_data* data = self->data;
+	return data->wet;
+}
+static void set_wet(nocta_unit* self, int wet) {
+	pitch_data* data = self->data;
+	data->wet = wet;
+}
+
+static int get_shift(nocta_unit* self) {
+	pitch_data* data = self->data;
+	return data->shift;
+}
+static void set_shift(nocta_unit* self, int shift) {
+	pitch_data* data = self->data;
+	data->shift = CLAMP(shift, -1200, 1200);
+	data->ratio = lround(pow(2, data->shift / 1200.0) * 65536);
+	update_grains(data);
+}
+
+static int get_grain(nocta_unit* self) {
+	pitch_data* data = self->data;
+	return data->grain;
+}
+static void set_grain(nocta_unit* self, int grain) {
+	pitch_data* data = self->data;
+	data->grain = CLAMP(grain, MIN_GRAIN, MAX_GRAIN);
+	update_grains(data);
+}
@@ -0,0 +1,135 @@
+#include "common.h"
+
+// A preset is laid out as:
+//   preset_header
+//   int32_t values[num_params]
+//   a copy of the first `preset_size` bytes of the unit's data (16-byte aligned)
+//
+// Recalling a preset just copies the data back, so no setters get called on
+// the audio thread. Units without a preset_size fall back to calling the
+// setters with the stored values, which still happens all at once.
+
+#define PRESET_MAGIC 0x6174636e // "ncta"
+
+typedef struct {
+	uint32_t magic;
+	uint32_t type;         // hash of the unit's name
+	uint32_t num_params;
+	uint32_t data_size;
+	uint32_t data_offset;
+} preset_header;
+
+// FNV-1a
+static uint32_t hash_name(const char* name) {
+	uint32_t hash = 2166136261u;
+	while (*name) {
+		hash ^= (uint8_t)*name++;
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+static size_t data_offset(int num_params) {
+	size_t offset = sizeof(preset_header) + num_params * sizeof(int32_t);
+	return (offset + 15) & ~(size_t)15;
+}
+
+static void write_header(nocta_unit* unit, void* preset) {
+	*(preset_header*)preset = (preset_header){
+		.magic = PRESET_MAGIC,
+		.type = hash_name(unit->name),
+		.num_params = unit->num_params,
+		.data_size = unit->preset_size,
+		.data_offset = data_offset(unit->num_params)
+	};
+	// clear the padding before the data, so the same settings always give the same bytes
+	size_t values_end = sizeof(preset_header) + unit->num_params * sizeof(int32_t);
+	memset((char*)preset + values_end, 0, data_offset(unit->num_params) - values_end);
+}
+
+static int32_t* preset_values(const void* preset) {
+	return (int32_t*)((char*)preset + sizeof(preset_header));
+}
+
+static void* preset_data(const void* preset) {
+	const preset_header* header = preset;
+	return (char*)preset + header->data_offset;
+}
+
+size_t nocta_preset_size(nocta_unit* unit) {
+	return data_offset(unit->num_params) + unit->preset_size;
+}
+
+void nocta_preset_capture(nocta_unit* unit, void* preset) {
+	write_header(unit, preset);
+	int32_t* values = preset_values(preset);
+	for (int i=0; i<unit->num_params; i++) {
+		values[i] = unit->params[i].get(unit);
+	}
+	memcpy(preset_data(preset), unit->data, unit->preset_size);
+}
+
+void nocta_preset_prepare(nocta_unit* unit, void* preset, const int* values) {
+	write_header(unit, preset);
+	int32_t* stored = preset_values(preset);
+
+	// run the setters on the data the unit was created with, instead of the
+	// real thing (which may be processing on another thread)
+	nocta_unit copy = *unit;
+	copy.data = preset_data(preset);
+	if (unit->preset_size) memcpy(copy.data, unit->initial_data, unit->preset_size);
+
+	for (int i=0; i<unit->num_params; i++) {
+		if (unit->preset_size) {
+			unit->params[i].set(&copy, values[i]);
+			stored[i] = unit->params[i].get(&copy);
+		} else {
+			stored[i] = values[i];
+		}
+	}
+}
+
+bool nocta_preset_check(nocta_unit* unit, const void* preset, size_t size) {
+	const preset_header* header = preset;
+	return size >= sizeof(preset_header)
+	    && header->magic == PRESET_MAGIC
+	    && header->type == hash_name(unit->name)
+	    && header->num_params == unit->num_params
+	    && header->data_size == unit->preset_size
+	    && header->data_offset == data_offset(unit->num_params)
+	    && size >= nocta_preset_size(unit);
+}
+
+int nocta_preset_get(const void* preset, int param_id) {
+	const preset_header* header = preset;
+	if (param_id >= header->num_params)
+		return 0;
+	return preset_values(preset)[param_id];
+}
+
+void nocta_preset_recall(nocta_unit* unit, const void* preset) {
+	__atomic_store_n(&unit->pending_preset, preset, __ATOMIC_RELEASE);
+}
+
+bool nocta_preset_pending(nocta_unit* unit) {
+	return __atomic_load_n(&unit->pending_preset, __ATOMIC_ACQUIRE) != NULL;
+}
+
+void preset_snapshot(nocta_unit* unit) {
+	if (!unit->preset_size)
+		return;
+	if (!unit->initial_data)
+		unit->initial_data = malloc(unit->preset_size);
+	memcpy(unit->initial_data, unit->data, unit->preset_size);
+}
+
+void preset_apply(nocta_unit* unit, const void* preset) {
+	if (unit->preset_size) {
+		memcpy(unit->data, preset_data(preset), unit->preset_size);
+		return;
+	}
+	int32_t* values = preset_values(preset);
+	for (int i=0; i<unit->num_params; i++) {
+		unit->params[i].set(unit, values[i]);
+	}
+}
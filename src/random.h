@@ -0,0 +1,31 @@
+#pragma once
+#include <stdint.h>
+#include "fixedpoint.h"
+
+// Fast pseudo-random numbers, with the state kept by each unit
+// (unlike rand(), which is slow, locks, and is shared by everything)
+
+// xorshift32 (the state must never be 0)
+inline static uint32_t xorshift32(uint32_t* state) {
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return *state = x;
+}
+
+// scramble a seed, so that similar seeds give unrelated sequences
+inline static uint32_t hash_seed(uint32_t x) {
+	x += 0x9e3779b9;
+	x ^= x >> 16;
+	x *= 0x7feb352d;
+	x ^= x >> 15;
+	x *= 0x846ca68b;
+	x ^= x >> 16;
+	return x ? x : 1;
+}
+
+// convert a random number to a 3:13 sample from -1.0 to 1.0
+inline static int random_to_fix(uint32_t x) {
+	return (int32_t)x >> (31 - FIX_PT);
+}
@@ -0,0 +1,232 @@
+#include "common.h"
+
+// Feedback delay network reverb.
+// Each sample, the outputs of all delay lines are read at once, damped by a
+// one-pole lowpass, mixed by a normalised Hadamard matrix and written back.
+// The lines share one write position and are interleaved, so the samples
+// written each tick are a single frame. The taps are read from a different
+// frame for each line, but from then on the lines are worked out side by side.
+
+#define NUM_LINES 8
+
+// delay line lengths in samples at 44100 Hz (mutually prime to avoid ringing)
+static const int base_lengths[NUM_LINES] = {
+	1031, 1327, 1523, 1801, 2053, 2311, 2633, 2903
+};
+
+static int get_dry(nocta_unit* self);
+static void set_dry(nocta_unit* self, int dry);
+static int get_wet(nocta_unit* self);
+static void set_wet(nocta_unit* self, int wet);
+static int get_size(nocta_unit* self);
+static void set_size(nocta_unit* self, int size);
+static int get_decay(nocta_unit* self);
+static void set_decay(nocta_unit* self, int decay);
+static int get_damping(nocta_unit* self);
+static void set_damping(nocta_unit* self, int damping);
+
+static nocta_param reverb_params[] = {
+	{"dry", 0, 255, get_dry, set_dry},
+	{"wet", 0, 255, get_wet, set_wet},
+	{"size", 0, 255, get_size, set_size},
+	{"decay", 0, 255, get_decay, set_decay},
+	{"damping", 0, 255, get_damping, set_damping}
+};
+
+typedef struct {
+	// parameters and derived values (captured by presets):
+	uint8_t dry, wet;
+	uint8_t size, decay, damping;
+	int gain;                // feedback gain (3:13), includes the matrix normalisation
+	int damp_coef;           // lowpass coefficient, 256 = no damping
+	int length[NUM_LINES];   // read offset of each line
+	int sample_rate;
+
+	// state:
+	int16_t* samples;        // line_size frames of NUM_LINES samples (one per line)
+	int line_size;           // power of 2
+	int pos;                 // shared write position
+	int lowpass[NUM_LINES];  // damping filter state of each line
+	int in_r;                // last right input (for single-sample processing)
+	int out_r;               // pending right output
+} reverb_data;
+
+static inline void reverb_run(reverb_data* data, int in_l, int in_r, int* out_l, int* out_r);
+static int reverb_l(nocta_unit* self, int x);
+static int reverb_r(nocta_unit* self, int x);
+static void reverb_buffer(nocta_unit* self, int16_t* buffer, size_t length);
+static void reverb_free(nocta_unit* self);
+
+nocta_unit* nocta_reverb(nocta_context* context) {
+
+	// enough room for the longest line at the maximum size
+	int max_length = (int64_t)base_lengths[NUM_LINES-1] * (64+255) / 192
+	               * context->sample_rate / 44100;
+	int line_size = 1;
+	while (line_size <= max_length) line_size *= 2;
+
+	reverb_data* data = ialloc(reverb_data,
+		.dry = 255,
+		.wet = 80,
+		.samples = calloc(NUM_LINES * line_size, sizeof(int16_t)),
+		.line_size = line_size,
+		.sample_rate = context->sample_rate
+	);
+
+	nocta_unit* self = nocta_create(
+		.context = context,
+		.name = "reverb",
+		.data = data,
+		.process_l = reverb_l,
+		.process_r = reverb_r,
+		.process_buffer = reverb_buffer,
+		.free = reverb_free,
+		.preset_size = offsetof(reverb_data, samples),
+		.params = reverb_params,
+		.num_params = NOCTA_REVERB_NUM_PARAMS
+	);
+
+	set_size(self, 128);
+	set_decay(self, 180);
+	set_damping(self, 100);
+	preset_snapshot(self);
+	return self;
+}
+
+static void reverb_free(nocta_unit* self) {
+	reverb_data* data = self->data;
+	free(data->samples);
+}
+
+static inline void reverb_run(reverb_data* data, int in_l, int in_r, int* out_l, int* out_r) {
+	int mask = data->line_size - 1;
+	int16_t* samples = data->samples;
+	int v[NUM_LINES];
+
+	// read every tap (each from its own frame) and apply damping
+	for (int k=0; k<NUM_LINES; k++) {
+		v[k] = samples[((data->pos - data->length[k]) & mask) * NUM_LINES + k];
+	}
+	for (int k=0; k<NUM_LINES; k++) {
+		data->lowpass[k] += (v[k] - data->lowpass[k]) * data->damp_coef / 256;
+		v[k] = data->lowpass[k];
+	}
+
+	// even lines go to the left output, odd lines to the right
+	int l = 0, r = 0;
+	for (int k=0; k<NUM_LINES; k+=2) {
+		l += v[k];
+		r += v[k+1];
+	}
+	*out_l = l >> 2;
+	*out_r = r >> 2;
+
+	// fast Walsh-Hadamard transform (only adds and subtracts), with every
+	// stage combining the two halves, which comes to the same as the usual
+	// butterflies of growing size
+	for (int stage=1; stage<NUM_LINES; stage*=2) {
+		int w[NUM_LINES];
+		for (int k=0; k<NUM_LINES/2; k++) {
+			w[k*2] = v[k] + v[k + NUM_LINES/2];
+			w[k*2+1] = v[k] - v[k + NUM_LINES/2];
+		}
+		memcpy(v, w, sizeof(v));
+	}
+
+	// feed back into the lines along with the new input, which fills a frame
+	// (round towards zero, so the tail can't get stuck at -1)
+	int16_t* frame = samples + (data->pos & mask) * NUM_LINES;
+	in_l >>= 1;
+	in_r >>= 1;
+	for (int k=0; k<NUM_LINES; k++) {
+		frame[k] = clip(v[k] * data->gain / FIX_1 + (k & 1 ? in_r : in_l));
+	}
+	data->pos++;
+}
+
+// the left channel drives the network, using the most recent right input
+static int reverb_l(nocta_unit* self, int x) {
+	reverb_data* data = self->data;
+	int out_l;
+	reverb_run(data, x, data->in_r, &out_l, &data->out_r);
+	return (x * data->dry >> 8)
+	     + (out_l * data->wet >> 8);
+}
+
+static int reverb_r(nocta_unit* self, int x) {
+	reverb_data* data = self->data;
+	data->in_r = x;
+	return (x * data->dry >> 8)
+	     + (data->out_r * data->wet >> 8);
+}
+
+static void reverb_buffer(nocta_unit* self, int16_t* buffer, size_t length) {
+	reverb_data* data = self->data;
+	for (size_t i=0; i<length/2; i++) {
+		int l = buffer[0];
+		int r = buffer[1];
+		int out_l, out_r;
+		reverb_run(data, l, r, &out_l, &out_r);
+		buffer[0] = clip((l * data->dry >> 8) + (out_l * data->wet >> 8));
+		buffer[1] = clip((r * data->dry >> 8) + (out_r * data->wet >> 8));
+		data->in_r = r;
+		buffer += 2;
+	}
+}
+
+
+// getters and setters:
+
+static int get_dry(nocta_unit* self) {
+	reverb_data* data = self->data;
+	return data->dry;
+}
+static void set_dry(nocta_unit* self, int dry) {
+	reverb_data* data = self->data;
+	data->dry = dry;
+}
+
+static int get_wet(nocta_unit* self) {
+	reverb_data* data = self->data;
+	return data->wet;
+}
+static void set_wet(nocta_unit* self, int wet) {
+	reverb_data* data = self->data;
+	data->wet = wet;
+}
+
+static int get_size(nocta_unit* self) {
+	reverb_data* data = self->data;
+	return data->size;
+}
+static void set_size(nocta_unit* self, int size) {
+	reverb_data* data = self->data;
+	data->size = size;
+	for (int k=0; k<NUM_LINES; k++) {
+		data->length[k] = (int64_t)base_lengths[k] * (64+size) / 192
+		                * data->sample_rate / 44100;
+	}
+}
+
+static int get_decay(nocta_unit* self) {
+	reverb_data* data = self->data;
+	return data->decay;
+}
+static void set_decay(nocta_unit* self, int decay) {
+	reverb_data* data = self->data;
+	data->decay = decay;
+
+	// the Hadamard matrix has a gain of sqrt(NUM_LINES), so scale by 1/sqrt(8)
+	// to keep the network stable (max feedback is just under 1.0)
+	data->gain = fix_mul(decay * 31, FIX_1 * 100 / 283);
+}
+
+static int get_damping(nocta_unit* self) {
+	reverb_data* data = self->data;
+	return data->damping;
+}
+static void set_damping(nocta_unit* self, int damping) {
+	reverb_data* data = self->data;
+	data->damping = damping;
+	data->damp_coef = 256 - damping*7/8;
+}
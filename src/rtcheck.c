@@ -0,0 +1,283 @@
+#define _GNU_SOURCE // for RTLD_NEXT and syscall
+#include "common.h"
+
+// Real-time safety checks (only built with NOCTA_RTCHECK).
+// The processing calls mark the time they run as a real-time region, on
+// their own thread. This file defines its own malloc, free, mutex locks and
+// blocking calls, which the linker picks instead of the C library's, so each
+// of them can check whether it was called from inside a region before
+// passing the call on. The length of every region is timed as well, against
+// the length of the audio it produced, so the worst case shows up in tests.
+
+#ifdef NOCTA_RTCHECK
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <dlfcn.h>
+#include <sys/select.h>
+#include <sys/syscall.h>
+
+// regions producing less audio than this aren't counted towards the load,
+// as the timer and the scheduler outweigh the processing
+#define MIN_TIMED_NS 1000000
+
+static __thread int depth;       // regions this thread is inside
+static __thread bool reporting;  // don't report the calls made while reporting
+static __thread uint64_t region_start;
+static __thread uint64_t region_cpu_start;
+static __thread uint64_t region_audio;  // length of the audio the region produces (ns)
+
+static bool abort_on_violation;
+static uint32_t violations;
+static uint64_t regions;
+static uint64_t worst_ns;
+static uint64_t worst_load;      // in thousandths of real time
+static const char* last_violation;
+
+static uint64_t clock_ns(clockid_t clock) {
+	struct timespec t;
+	clock_gettime(clock, &t);
+	return t.tv_sec * 1000000000ull + t.tv_nsec;
+}
+
+static void store_max(uint64_t* worst, uint64_t value) {
+	uint64_t w = __atomic_load_n(worst, __ATOMIC_RELAXED);
+	while (value > w && !__atomic_compare_exchange_n(worst, &w, value,
+		true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+void rt_enter(int sample_rate, size_t frames) {
+	if (depth++ == 0) {
+		region_audio = frames * 1000000000ull / sample_rate;
+		region_start = clock_ns(CLOCK_MONOTONIC);
+		region_cpu_start = clock_ns(CLOCK_THREAD_CPUTIME_ID);
+	}
+}
+
+void rt_leave(void) {
+	if (--depth > 0)
+		return;
+	uint64_t ns = clock_ns(CLOCK_MONOTONIC) - region_start;
+	store_max(&worst_ns, ns);
+	// the load counts only the time this thread ran, so being preempted on a
+	// busy machine doesn't make the processing look slow
+	uint64_t cpu_ns = clock_ns(CLOCK_THREAD_CPUTIME_ID) - region_cpu_start;
+	if (region_audio >= MIN_TIMED_NS)
+		store_max(&worst_load, cpu_ns * 1000 / region_audio);
+	__atomic_fetch_add(&regions, 1, __ATOMIC_RELAXED);
+}
+
+static void violation(const char* call) {
+	if (depth == 0 || reporting)
+		return;
+	reporting = true;
+	__atomic_fetch_add(&violations, 1, __ATOMIC_RELAXED);
+	__atomic_store_n(&last_violation, call, __ATOMIC_RELAXED);
+
+	// straight to the kernel, as write() is checked too
+	char message[128];
+	int n = snprintf(message, sizeof(message), "nocta: %s() called while processing\n", call);
+	syscall(SYS_write, 2, message, MIN(n, (int)sizeof(message) - 1));
+	if (abort_on_violation)
+		abort();
+	reporting = false;
+}
+
+// find the next definition of a function, after this one
+#define REAL(name) \
+	static __typeof__(name)* real_##name; \
+	if (!real_##name) real_##name = (__typeof__(name)*)dlsym(RTLD_NEXT, #name)
+
+#ifdef __GLIBC__
+// glibc's own entry points, which don't need dlsym (that allocates)
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* p, size_t size);
+void __libc_free(void* p);
+
+void* malloc(size_t size) {
+	violation("malloc");
+	return __libc_malloc(size);
+}
+void* calloc(size_t count, size_t size) {
+	violation("calloc");
+	return __libc_calloc(count, size);
+}
+void* realloc(void* p, size_t size) {
+	violation("realloc");
+	return __libc_realloc(p, size);
+}
+
+void* __libc_memalign(size_t alignment, size_t size);
+
+void* memalign(size_t alignment, size_t size) {
+	violation("memalign");
+	return __libc_memalign(alignment, size);
+}
+void* aligned_alloc(size_t alignment, size_t size) {
+	violation("aligned_alloc");
+	return __libc_memalign(alignment, size);
+}
+int posix_memalign(void** p, size_t alignment, size_t size) {
+	violation("posix_memalign");
+	if (alignment % sizeof(void*) != 0 || (alignment & (alignment - 1)) != 0)
+		return EINVAL;
+	*p = __libc_memalign(alignment, size);
+	return *p ? 0 : ENOMEM;
+}
+void* valloc(size_t size) {
+	violation("valloc");
+	return __libc_memalign(sysconf(_SC_PAGESIZE), size);
+}
+void free(void* p) {
+	if (p) violation("free");
+	__libc_free(p);
+}
+#endif
+
+int pthread_mutex_lock(pthread_mutex_t* mutex) {
+	REAL(pthread_mutex_lock);
+	violation("pthread_mutex_lock");
+	return real_pthread_mutex_lock(mutex);
+}
+int pthread_mutex_timedlock(pthread_mutex_t* mutex, const struct timespec* timeout) {
+	REAL(pthread_mutex_timedlock);
+	violation("pthread_mutex_timedlock");
+	return real_pthread_mutex_timedlock(mutex, timeout);
+}
+int pthread_rwlock_rdlock(pthread_rwlock_t* lock) {
+	REAL(pthread_rwlock_rdlock);
+	violation("pthread_rwlock_rdlock");
+	return real_pthread_rwlock_rdlock(lock);
+}
+int pthread_rwlock_wrlock(pthread_rwlock_t* lock) {
+	REAL(pthread_rwlock_wrlock);
+	violation("pthread_rwlock_wrlock");
+	return real_pthread_rwlock_wrlock(lock);
+}
+int pthread_rwlock_timedrdlock(pthread_rwlock_t* lock, const struct timespec* timeout) {
+	REAL(pthread_rwlock_timedrdlock);
+	violation("pthread_rwlock_timedrdlock");
+	return real_pthread_rwlock_timedrdlock(lock, timeout);
+}
+int pthread_rwlock_timedwrlock(pthread_rwlock_t* lock, const struct timespec* timeout) {
+	REAL(pthread_rwlock_timedwrlock);
+	violation("pthread_rwlock_timedwrlock");
+	return real_pthread_rwlock_timedwrlock(lock, timeout);
+}
+int pthread_cond_wait(pthread_cond_t* cond, pthread_mutex_t* mutex) {
+	REAL(pthread_cond_wait);
+	violation("pthread_cond_wait");
+	return real_pthread_cond_wait(cond, mutex);
+}
+int pthread_cond_timedwait(pthread_cond_t* cond, pthread_mutex_t* mutex, const struct timespec* timeout) {
+	REAL(pthread_cond_timedwait);
+	violation("pthread_cond_timedwait");
+	return real_pthread_cond_timedwait(cond, mutex, timeout);
+}
+int sem_wait(sem_t* sem) {
+	REAL(sem_wait);
+	violation("sem_wait");
+	return real_sem_wait(sem);
+}
+int sem_timedwait(sem_t* sem, const struct timespec* timeout) {
+	REAL(sem_timedwait);
+	violation("sem_timedwait");
+	return real_sem_timedwait(sem, timeout);
+}
+int nanosleep(const struct timespec* duration, struct timespec* remaining) {
+	REAL(nanosleep);
+	violation("nanosleep");
+	return real_nanosleep(duration, remaining);
+}
+int clock_nanosleep(clockid_t clock, int flags, const struct timespec* duration, struct timespec* remaining) {
+	REAL(clock_nanosleep);
+	violation("clock_nanosleep");
+	return real_clock_nanosleep(clock, flags, duration, remaining);
+}
+int usleep(useconds_t usec) {
+	REAL(usleep);
+	violation("usleep");
+	return real_usleep(usec);
+}
+unsigned int sleep(unsigned int seconds) {
+	REAL(sleep);
+	violation("sleep");
+	return real_sleep(seconds);
+}
+int poll(struct pollfd* fds, nfds_t count, int timeout) {
+	REAL(poll);
+	violation("poll");
+	return real_poll(fds, count, timeout);
+}
+int select(int count, fd_set* read_fds, fd_set* write_fds, fd_set* except_fds, struct timeval* timeout) {
+	REAL(select);
+	violation("select");
+	return real_select(count, read_fds, write_fds, except_fds, timeout);
+}
+int open(const char* path, int flags, ...) {
+	REAL(open);
+	violation("open");
+	va_list args;
+	va_start(args, flags);
+	mode_t mode = flags & (O_CREAT | O_TMPFILE) ? va_arg(args, mode_t) : 0;
+	va_end(args);
+	return real_open(path, flags, mode);
+}
+FILE* fopen(const char* path, const char* mode) {
+	REAL(fopen);
+	violation("fopen");
+	return real_fopen(path, mode);
+}
+ssize_t read(int fd, void* buffer, size_t size) {
+	REAL(read);
+	violation("read");
+	return real_read(fd, buffer, size);
+}
+ssize_t write(int fd, const void* buffer, size_t size) {
+	REAL(write);
+	violation("write");
+	return real_write(fd, buffer, size);
+}
+
+bool nocta_rtcheck_read(nocta_rtcheck_stats* stats) {
+	*stats = (nocta_rtcheck_stats){
+		.violations = __atomic_load_n(&violations, __ATOMIC_RELAXED),
+		.last = __atomic_load_n(&last_violation, __ATOMIC_RELAXED),
+		.regions = __atomic_load_n(&regions, __ATOMIC_RELAXED),
+		.worst = __atomic_load_n(&worst_ns, __ATOMIC_RELAXED) * 1e-9,
+		.worst_load = __atomic_load_n(&worst_load, __ATOMIC_RELAXED) * 1e-3
+	};
+	return true;
+}
+
+void nocta_rtcheck_reset(void) {
+	__atomic_store_n(&violations, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&last_violation, NULL, __ATOMIC_RELAXED);
+	__atomic_store_n(&regions, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&worst_ns, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&worst_load, 0, __ATOMIC_RELAXED);
+}
+
+void nocta_rtcheck_abort(bool enable) {
+	abort_on_violation = enable;
+}
+
+#else
+
+bool nocta_rtcheck_read(nocta_rtcheck_stats* stats) {
+	*stats = (nocta_rtcheck_stats){0};
+	return false;
+}
+
+void nocta_rtcheck_reset(void) {}
+void nocta_rtcheck_abort(bool enable) {}
+
+#endif
@@ -0,0 +1,290 @@
+#include "common.h"
+#include "bank.h"
+
+// Sampler.
+// Plays a region of a sample bank, pitched by a 32:32 fixed point step
+// through the samples, with linear interpolation. Starting a voice only sets
+// up its pointer and step, so the samples are never copied, and voices
+// which have finished are dropped from the list so they cost nothing.
+// Voices are mixed a chunk at a time into a 32-bit buffer, and each voice is
+// rendered in runs which can't reach the end of its region, so the inner
+// loop has no bounds checks.
+
+#define MAX_VOICES 32
+#define CHUNK 256   // frames mixed at a time
+
+static int get_vol(nocta_unit* self);
+static void set_vol(nocta_unit* self, int vol);
+static int get_root(nocta_unit* self);
+static void set_root(nocta_unit* self, int root);
+static int get_start(nocta_unit* self);
+static void set_start(nocta_unit* self, int start);
+static int get_length(nocta_unit* self);
+static void set_length(nocta_unit* self, int length);
+static int get_loop_start(nocta_unit* self);
+static void set_loop_start(nocta_unit* self, int loop_start);
+static int get_loop_length(nocta_unit* self);
+static void set_loop_length(nocta_unit* self, int loop_length);
+
+static nocta_param sampler_params[] = {
+	{"volume", 0, 255, get_vol, set_vol},
+	{"root", 0, 127, get_root, set_root},
+	{"start", 0, INT32_MAX, get_start, set_start},
+	{"length", 0, INT32_MAX, get_length, set_length},
+	{"loop start", 0, INT32_MAX, get_loop_start, set_loop_start},
+	{"loop length", 0, INT32_MAX, get_loop_length, set_loop_length}
+};
+
+typedef struct {
+	const int16_t* samples;   // start of the region
+	uint64_t pos;             // position in 32:32
+	uint64_t step;
+	uint32_t end;             // length of the region
+	uint32_t loop_start, loop_end;
+	bool looping;
+	int note;
+} sampler_voice;
+
+typedef struct {
+	// parameters and derived values (captured by presets):
+	uint8_t vol;
+	int root;
+	uint32_t start, length;
+	uint32_t loop_start, loop_length;
+	uint32_t rate_step;   // step at the root note, in 16:16
+
+	// state:
+	nocta_bank* bank;
+	sampler_voice voices[MAX_VOICES];  // oldest first
+	int num_voices;
+	int last;   // mono output of the current frame, for process_r
+} sampler_data;
+
+static void sampler_note(nocta_unit* self, int note, bool on);
+static int sampler_l(nocta_unit* self, int x);
+static int sampler_r(nocta_unit* self, int x);
+static void sampler_buffer(nocta_unit* self, int16_t* buffer, size_t length);
+
+nocta_unit* nocta_sampler(nocta_context* context, nocta_bank* bank) {
+
+	// the pitch of the bank played back at the context's sample rate
+	uint32_t rate_step = ((uint64_t)bank->sample_rate << 16) / context->sample_rate;
+
+	return nocta_create(
+		.context = context,
+		.name = "sampler",
+		.data = ialloc(sampler_data,
+			.vol = 128,
+			.root = 60,
+			.rate_step = rate_step,
+			.bank = bank
+		),
+		.process_l = sampler_l,
+		.process_r = sampler_r,
+		.process_buffer = sampler_buffer,
+		.note = sampler_note,
+		.params = sampler_params,
+		.num_params = NOCTA_SAMPLER_NUM_PARAMS,
+		.preset_size = offsetof(sampler_data, bank)
+	);
+}
+
+// 2^(n/12) for each semitone of an octave, in 2:30
+static const uint32_t semitones[12] = {
+	1073741824, 1137589835, 1205234447, 1276901416, 1352829926, 1433273379,
+	1518500250, 1608794973, 1704458901, 1805811301, 1913190429, 2026954652
+};
+
+// step through the samples (in 32:32) to play a note
+static uint64_t note_step(sampler_data* data, int note) {
+	int n = note - data->root + 132; // keep it positive, for the division
+	int octave = n / 12 - 11;
+	uint64_t step = (uint64_t)data->rate_step * semitones[n % 12] >> 14;
+	return octave >= 0 ? step << octave : step >> -octave;
+}
+
+void nocta_sampler_stop(nocta_unit* self) {
+	sampler_data* data = self->data;
+	data->num_voices = 0;
+}
+
+static void sampler_note(nocta_unit* self, int note, bool on) {
+	sampler_data* data = self->data;
+	note = CLAMP(note, 0, 127);
+
+	if (!on) {
+		// let the note play out to the end of the region
+		for (int i=0; i<data->num_voices; i++) {
+			if (data->voices[i].note == note)
+				data->voices[i].looping = false;
+		}
+		return;
+	}
+
+	// take over the oldest voice if they're all playing
+	if (data->num_voices == MAX_VOICES) {
+		memmove(&data->voices[0], &data->voices[1], (MAX_VOICES-1) * sizeof(sampler_voice));
+		data->num_voices--;
+	}
+
+	nocta_bank* bank = data->bank;
+	uint32_t start = MIN(data->start, bank->length);
+	uint32_t length = data->length ? data->length : bank->length;
+	length = MIN(length, bank->length - start);
+	if (length == 0)
+		return;
+	uint32_t loop_start = MIN(data->loop_start, length);
+	uint32_t loop_end = MIN(loop_start + (uint64_t)data->loop_length, length);
+
+	data->voices[data->num_voices++] = (sampler_voice){
+		.samples = bank->samples + start,
+		.pos = 0,
+		.step = MAX(note_step(data, note), 1),
+		.end = length,
+		.loop_start = loop_start,
+		.loop_end = loop_end,
+		.looping = loop_end > loop_start,
+		.note = note
+	};
+}
+
+// mix `frames` frames of a voice into `mix`, and return false once it's finished
+static bool render_voice(sampler_voice* v, int* mix, int frames) {
+	const int16_t* s = v->samples;
+	uint64_t pos = v->pos;
+	uint64_t step = v->step;
+	int f = 0;
+
+	while (f < frames) {
+		uint32_t end = v->looping ? v->loop_end : v->end;
+		uint32_t i = pos >> 32;
+		if (i >= end) {
+			if (!v->looping)
+				return false;
+			pos -= (uint64_t)(v->loop_end - v->loop_start) << 32;
+			continue;
+		}
+
+		if (i + 1 < end) {
+			// run up to the last sample, so the next one is always there
+			uint64_t last = (uint64_t)(end - 1) << 32;
+			int n = MIN((uint64_t)(frames - f), (last - pos + step - 1) / step);
+			for (int k=0; k<n; k++) {
+				uint32_t j = pos >> 32;
+				int t = (pos >> 17) & 0x7fff;
+				mix[f+k] += s[j] + ((s[j+1] - s[j]) * t >> 15);
+				pos += step;
+			}
+			f += n;
+		} else {
+			// the last sample leads back to the loop, or into silence
+			int next = v->looping ? s[v->loop_start] : 0;
+			int t = (pos >> 17) & 0x7fff;
+			mix[f++] += s[i] + ((next - s[i]) * t >> 15);
+			pos += step;
+		}
+	}
+
+	v->pos = pos;
+	return true;
+}
+
+// mix all the voices, and drop the ones which have finished
+static void render_voices(sampler_data* data, int* mix, int frames) {
+	memset(mix, 0, frames * sizeof(int));
+	int n = 0;
+	for (int i=0; i<data->num_voices; i++) {
+		if (render_voice(&data->voices[i], mix, frames))
+			data->voices[n++] = data->voices[i];
+	}
+	data->num_voices = n;
+}
+
+static int sampler_l(nocta_unit* self, int x) {
+	sampler_data* data = self->data;
+	int mix = 0;
+	if (data->num_voices)
+		render_voices(data, &mix, 1);
+	data->last = mix * data->vol >> 7;
+	return x + data->last;
+}
+
+static int sampler_r(nocta_unit* self, int x) {
+	sampler_data* data = self->data;
+	return x + data->last;
+}
+
+static void sampler_buffer(nocta_unit* self, int16_t* buffer, size_t length) {
+	sampler_data* data = self->data;
+	int mix[CHUNK];
+	size_t frames = length / 2;
+	while (frames > 0 && data->num_voices > 0) {
+		int n = MIN(frames, CHUNK);
+		render_voices(data, mix, n);
+		int vol = data->vol;
+		for (int i=0; i<n; i++) {
+			int y = mix[i] * vol >> 7;
+			buffer[0] = clip(buffer[0] + y);
+			buffer[1] = clip(buffer[1] + y);
+			buffer += 2;
+		}
+		frames -= n;
+	}
+}
+
+
+// getters and setters:
+
+static int get_vol(nocta_unit* self) {
+	sampler_data* data = self->data;
+	return data->vol;
+}
+static void set_vol(nocta_unit* self, int vol) {
+	sampler_data* data = self->data;
+	data->vol = vol;
+}
+
+static int get_root(nocta_unit* self) {
+	sampler_data* data = self->data;
+	return data->root;
+}
+static void set_root(nocta_unit* self, int root) {
+	sampler_data* data = self->data;
+	data->root = CLAMP(root, 0, 127);
+}
+
+static int get_start(nocta_unit* self) {
+	sampler_data* data = self->data;
+	return data->start;
+}
+static void set_start(nocta_unit* self, int start) {
+	sampler_data* data = self->data;
+	data->start = MAX(start, 0);
+}
+
+static int get_length(nocta_unit* self) {
+	sampler_data* data = self->data;
+	return data->length;
+}
+static void set_length(nocta_unit* self, int length) {
+	sampler_data* data = self->data;
+	data->length = MAX(length, 0);
+}
+
+static int get_loop_start(nocta_unit* self) {
+	sampler_data* data = self->data;
+	return data->loop_start;
+}
+static void set_loop_start(nocta_unit* self, int loop_start) {
+	sampler_data* data = self->data;
+	data->loop_start = MAX(loop_start, 0);
+}
+
+static int get_loop_length(nocta_unit* self) {
+	sampler_data* data = self->data;
+	return data->loop_length;
+}
+static void set_loop_length(nocta_unit* self, int loop_length) {
+	sampler_data* data = self->data;
+	data->loop_length = MAX(loop_length, 0);
+}
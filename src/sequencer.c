@@ -0,0 +1,153 @@
+#include "common.h"
+
+// Sequencer.
+// Each track is a chain of units, starting with the one that plays its
+// notes, and the tracks are mixed through a graph (see graph.c), so
+// their buffers come from the context's pool. The events are read straight
+// from the caller's array, which is sorted by time, so rendering only has to
+// look at the next one: blocks are split wherever it's due, and everything in
+// between is rendered in one go, as far ahead as the caller likes.
+
+#define BLOCK 2048   // samples per graph block
+
+typedef struct {
+	nocta_unit* units[NOCTA_SEQ_MAX_UNITS];
+	int count;
+} seq_track;
+
+struct nocta_seq {
+	nocta_context* context;
+	nocta_graph* graph;
+	seq_track* tracks;
+	int num_tracks;
+
+	const nocta_seq_event* events;
+	int num_events;
+	int next;            // next event to apply
+	uint32_t length;     // time of the last event, in ticks
+	uint32_t tick_frames;
+	uint64_t pos;        // frames since the start of the sequence
+	bool loop;
+	bool playing;
+};
+
+nocta_seq* nocta_seq_create(nocta_context* context) {
+	nocta_seq* seq = ialloc(nocta_seq,
+		.context = context,
+		.graph = nocta_graph_create(context),
+		.tick_frames = 1
+	);
+	// the tracks are mixed into whatever is already in the buffer
+	nocta_graph_connect(seq->graph, NOCTA_GRAPH_INPUT, NOCTA_GRAPH_OUTPUT);
+	return seq;
+}
+
+void nocta_seq_free(nocta_seq* seq) {
+	nocta_graph_free(seq->graph);
+	free(seq->tracks);
+	free(seq);
+}
+
+int nocta_seq_track(nocta_seq* seq, nocta_unit** units, int count) {
+	if (count < 1 || count > NOCTA_SEQ_MAX_UNITS || seq->num_tracks == NOCTA_SEQ_MAX_TRACKS)
+		return -1;
+
+	seq->tracks = realloc(seq->tracks, (seq->num_tracks + 1) * sizeof(seq_track));
+	seq_track* track = &seq->tracks[seq->num_tracks];
+	track->count = count;
+	int prev = -1;
+	for (int i=0; i<count; i++) {
+		track->units[i] = units[i];
+		int node = nocta_graph_add(seq->graph, units[i]);
+		if (prev >= 0) nocta_graph_connect(seq->graph, prev, node);
+		prev = node;
+	}
+	nocta_graph_connect(seq->graph, prev, NOCTA_GRAPH_OUTPUT);
+
+	// build the graph now, so rendering never allocates
+	nocta_graph_compile(seq->graph, BLOCK);
+	return seq->num_tracks++;
+}
+
+void nocta_seq_tick(nocta_seq* seq, uint32_t frames) {
+	seq->tick_frames = MAX(frames, 1);
+}
+
+void nocta_seq_play(nocta_seq* seq, const nocta_seq_event* events, int count, bool loop) {
+	seq->events = events;
+	seq->num_events = count;
+	seq->next = 0;
+	seq->length = count ? events[count-1].time : 0;
+	seq->pos = 0;
+	seq->loop = loop && seq->length > 0;
+	seq->playing = count > 0;
+}
+
+void nocta_seq_stop(nocta_seq* seq) {
+	seq->playing = false;
+}
+
+bool nocta_seq_playing(nocta_seq* seq) {
+	return seq->playing;
+}
+
+static void apply_event(nocta_seq* seq, const nocta_seq_event* e) {
+	if (e->track >= seq->num_tracks)
+		return;
+	seq_track* track = &seq->tracks[e->track];
+
+	switch (e->command) {
+		case NOCTA_SEQ_NOTE_ON:
+			nocta_note_on(track->units[0], e->value);
+			break;
+		case NOCTA_SEQ_NOTE_OFF:
+			nocta_note_off(track->units[0], e->value);
+			break;
+		case NOCTA_SEQ_END:
+			break;
+		default: {
+			int unit = e->command >> 4 & 7;
+			if (e->command & 0x80 && unit < track->count)
+				nocta_set(track->units[unit], e->command & 15, e->value);
+		}
+	}
+}
+
+// frame where an event is due
+static uint64_t event_frame(nocta_seq* seq, const nocta_seq_event* e) {
+	return (uint64_t)e->time * seq->tick_frames;
+}
+
+// apply the events that are due, and return the number of frames until the next one
+static uint64_t run_sequence(nocta_seq* seq) {
+	while (seq->playing) {
+		if (seq->next == seq->num_events) {
+			if (!seq->loop) {
+				seq->playing = false;
+				break;
+			}
+			seq->next = 0;
+			seq->pos = 0;
+		}
+		const nocta_seq_event* e = &seq->events[seq->next];
+		uint64_t due = event_frame(seq, e);
+		if (due > seq->pos)
+			return due - seq->pos;
+		apply_event(seq, e);
+		seq->next++;
+	}
+	return UINT64_MAX;
+}
+
+void nocta_seq_render(nocta_seq* seq, int16_t* buffer, size_t length) {
+	RT_ENTER(seq->context->sample_rate, length / 2);
+	size_t frames = length / 2;
+	while (frames > 0) {
+		size_t n = MIN(frames, run_sequence(seq));
+		nocta_graph_process(seq->graph, buffer, n * 2);
+		buffer += n * 2;
+		frames -= n;
+		seq->pos += n;
+	}
+	RT_LEAVE();
+}
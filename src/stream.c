@@ -0,0 +1,145 @@
+#include "common.h"
+
+// Render-ahead streams.
+// A worker thread calls the render function a block at a time, into a ring
+// of `blocks` blocks, and the audio callback copies out of it. The ring has
+// one writer and one reader, so the only shared state is the two positions:
+// each side publishes its own with a release store after touching the
+// samples, and reads the other's with an acquire load. The callback never
+// waits: if the worker has fallen behind, it gets what there is, and the
+// rest is silence.
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <pthread.h>
+#include <time.h>
+
+struct nocta_stream {
+	nocta_render_cb render;
+	void* user;
+	int16_t* ring;
+	size_t block;          // samples rendered at a time
+	size_t size;           // samples in the ring (a whole number of blocks)
+	long wait_ns;          // how long the worker sleeps when the ring is full
+	int sample_rate;
+
+	// positions, in samples since the start (only ever increasing)
+	size_t written;        // set by the worker
+	size_t read;           // set by the callback
+
+	uint32_t underruns;
+	bool running;
+	pthread_t thread;
+};
+
+// render the next block into the ring (only called by the worker, or before it starts)
+static void render_block(nocta_stream* stream) {
+	size_t pos = stream->written;
+	int16_t* dest = stream->ring + pos % stream->size;
+	memset(dest, 0, stream->block * sizeof(int16_t));
+	stream->render(stream->user, dest, stream->block);
+	__atomic_store_n(&stream->written, pos + stream->block, __ATOMIC_RELEASE);
+}
+
+static void* worker(void* arg) {
+	nocta_stream* stream = arg;
+	struct timespec wait = { 0, stream->wait_ns };
+	while (__atomic_load_n(&stream->running, __ATOMIC_RELAXED)) {
+		size_t read = __atomic_load_n(&stream->read, __ATOMIC_ACQUIRE);
+		if (stream->written + stream->block - read <= stream->size)
+			render_block(stream);
+		else
+			nanosleep(&wait, NULL);
+	}
+	return NULL;
+}
+
+nocta_stream* nocta_stream_start(nocta_context* context, nocta_render_cb render, void* user,
+                                 size_t block, int blocks) {
+	block &= ~(size_t)1;
+	if (block == 0 || blocks < 1)
+		return NULL;
+
+	nocta_stream* stream = ialloc(nocta_stream,
+		.render = render,
+		.user = user,
+		.ring = malloc(block * blocks * sizeof(int16_t)),
+		.block = block,
+		.size = block * blocks,
+		// check back 4 times per block
+		.wait_ns = MIN((uint64_t)(block / 2) * 1000000000 / context->sample_rate / 4, 999999999),
+		.sample_rate = context->sample_rate,
+		.running = true
+	);
+
+	// fill the ring first, so the callback has something from the start
+	for (int i=0; i<blocks; i++) render_block(stream);
+
+	if (pthread_create(&stream->thread, NULL, worker, stream) != 0) {
+		free(stream->ring);
+		free(stream);
+		return NULL;
+	}
+	return stream;
+}
+
+void nocta_stream_stop(nocta_stream* stream) {
+	__atomic_store_n(&stream->running, false, __ATOMIC_RELAXED);
+	pthread_join(stream->thread, NULL);
+	free(stream->ring);
+	free(stream);
+}
+
+size_t nocta_stream_read(nocta_stream* stream, int16_t* buffer, size_t length) {
+	RT_ENTER(stream->sample_rate, length / 2);
+	size_t read = stream->read;
+	size_t ready = __atomic_load_n(&stream->written, __ATOMIC_ACQUIRE) - read;
+	size_t n = MIN(length, ready);
+
+	// copy in up to two parts, where the ring wraps around
+	size_t start = read % stream->size;
+	size_t first = MIN(n, stream->size - start);
+	memcpy(buffer, stream->ring + start, first * sizeof(int16_t));
+	memcpy(buffer + first, stream->ring, (n - first) * sizeof(int16_t));
+	__atomic_store_n(&stream->read, read + n, __ATOMIC_RELEASE);
+
+	if (n < length) {
+		memset(buffer + n, 0, (length - n) * sizeof(int16_t));
+		__atomic_fetch_add(&stream->underruns, 1, __ATOMIC_RELAXED);
+	}
+	RT_LEAVE();
+	return n;
+}
+
+size_t nocta_stream_buffered(nocta_stream* stream) {
+	return __atomic_load_n(&stream->written, __ATOMIC_ACQUIRE)
+	     - __atomic_load_n(&stream->read, __ATOMIC_RELAXED);
+}
+
+uint32_t nocta_stream_underruns(nocta_stream* stream) {
+	return __atomic_load_n(&stream->underruns, __ATOMIC_RELAXED);
+}
+
+#else
+
+// no threads to render ahead with
+nocta_stream* nocta_stream_start(nocta_context* context, nocta_render_cb render, void* user,
+                                 size_t block, int blocks) {
+	return NULL;
+}
+
+void nocta_stream_stop(nocta_stream* stream) {}
+
+size_t nocta_stream_read(nocta_stream* stream, int16_t* buffer, size_t length) {
+	memset(buffer, 0, length * sizeof(int16_t));
+	return 0;
+}
+
+size_t nocta_stream_buffered(nocta_stream* stream) {
+	return 0;
+}
+
+uint32_t nocta_stream_underruns(nocta_stream* stream) {
+	return 0;
+}
+
+#endif
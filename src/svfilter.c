@@ -1,4 +1,5 @@
 #include "common.h"
+#include "utils.h"
 
 /*
 //Input/Output
@@ -32,19 +33,24 @@ static void set_vol(nocta_unit* self, int vol);
 static void set_mode(nocta_unit* self, int mode);
 static void set_freq(nocta_unit* self, int freq);
 static void set_res(nocta_unit* self, int res);
+static void modulate_freq(nocta_unit* self, const int* values);
 
 static nocta_param svfilter_params[] = {
 	{"volume", 0, 255, get_vol, set_vol},
 	{"mode", 0, NOCTA_FILTER_NUM_MODES-1, get_mode, set_mode},
-	{"frequency", 0, 10000, get_freq, set_freq},
+	{"frequency", 0, 10000, get_freq, set_freq, modulate_freq},
 	{"resoncance", 0, 255, get_res, set_res}
 };
 
 typedef struct {
 	int lp, hp, bp, n;
-	int* out;
 } filter_state;
 
+// same layout as filter_state, so `out` works for both
+typedef struct {
+	float lp, hp, bp, n;
+} float_state;
+
 typedef struct {
 	uint8_t vol;
 	int mode;
@@ -52,52 +58,161 @@ typedef struct {
 	uint8_t res;
 	int tuned_freq;
 	int tuned_res;
+	float tuned_freq_f;
+	float tuned_res_f;
+	int out;        // offset of the output for the current mode in filter_state
+	int freq_scale; // converts a frequency to a sine table position (24:8)
+	int max_freq;   // highest modulated frequency
+	
+	// state (everything above is captured by presets):
 	filter_state l, r;
+	float_state fl, fr;
+	const int* mod_freq;
+	int gain;        // 16:16, folded in from gainers by a graph
 } filter_data;
 
 // get the next sample
-static int svfilter_run(filter_data* data, filter_state* state, int input);
+static int svfilter_run(filter_data* data, filter_state* state, int input, int tuned_freq, int vol);
 static int svfilter_l(nocta_unit* self, int x);
 static int svfilter_r(nocta_unit* self, int x);
+static void svfilter_buffer(nocta_unit* self, int16_t* buffer, size_t length);
+static void svfilter_float(nocta_unit* self, float* buffer, size_t length);
 
 nocta_unit* nocta_svfilter(nocta_context* context) {
 	
+	build_sine_table(context);
+	
 	nocta_unit* self = nocta_create(
 		.context = context, 
 		.name = "svfilter",
 		.data = ialloc(filter_data,
 			.vol = 255,
 			.freq = 7000,
-			.res = 0
+			.res = 0,
+			.freq_scale = (65536 << 8) / context->sample_rate,
+			// the filter is only stable up to a third of the sample rate, which
+			// also keeps lookups inside the sine table at low sample rates
+			.max_freq = MIN(10000, context->sample_rate / 3),
+			.gain = 65536
 		),
 		.process_l = svfilter_l,
 		.process_r = svfilter_r,
+		.process_buffer = svfilter_buffer,
+		.process_float = svfilter_float,
 		.params = svfilter_params,
-		.num_params = NOCTA_FILTER_NUM_PARAMS);
+		.num_params = NOCTA_FILTER_NUM_PARAMS,
+		.preset_size = offsetof(filter_data, l));
 	
 	set_mode(self, NOCTA_FILTER_MODE_LOWPASS);
+	preset_snapshot(self);
 	return self;
 }
 
+// position in the sine table for a modulated frequency
+static inline int sine_pos(filter_data* data, int freq) {
+	return CLAMP(freq, 0, data->max_freq) * data->freq_scale >> 8;
+}
+
+// tuned frequency for the current frame
+static inline int frame_freq(nocta_unit* self, filter_data* data) {
+	if (!data->mod_freq) return data->tuned_freq;
+	int x = sine_pos(data, data->mod_freq[self->block_pos]);
+	return 2 * sine_lookup(self->context->tables->sine, x);
+}
+
+// output volume (16:16), with any gain folded in at full precision, so a
+// quiet fused run isn't rounded to a whole step of the 8-bit volume
+static inline int out_vol(filter_data* data) {
+	return (int64_t)data->vol * data->gain >> 8;
+}
+
 static int svfilter_l(nocta_unit* self, int x) {
 	filter_data* data = self->data;
-	return svfilter_run(data, &data->l, x);
+	return svfilter_run(data, &data->l, x, frame_freq(self, data), out_vol(data));
 }
 static int svfilter_r(nocta_unit* self, int x) {
 	filter_data* data = self->data;
-	return svfilter_run(data, &data->r, x);
+	return svfilter_run(data, &data->r, x, frame_freq(self, data), out_vol(data));
 }
 
-static int svfilter_run(filter_data* data, filter_state* s, int input) {
+static inline int svfilter_run(filter_data* data, filter_state* s, int input, int tuned_freq, int vol) {
 	int output = 0;
 	for (int i=0; i<2; i++) {
-		s->lp = s->lp + fix_mul(data->tuned_freq, s->bp);
+		s->lp = s->lp + fix_mul(tuned_freq, s->bp);
 		s->hp = input - s->lp - fix_mul(data->tuned_res, s->bp);
-		s->bp = fix_mul(data->tuned_freq, s->hp) + s->bp;
+		s->bp = fix_mul(tuned_freq, s->hp) + s->bp;
 		s->n = s->hp + s->lp;
-		output += *s->out / 2;
+		output += *(int*)((char*)s + data->out) / 2;
 	}
-	return (output * data->vol) >> 8;
+	return (int64_t)output * vol >> 16;
+}
+
+static void svfilter_buffer(nocta_unit* self, int16_t* buffer, size_t length) {
+	filter_data* data = self->data;
+	size_t frames = length / 2;
+	int vol = out_vol(data);
+	
+	if (!data->mod_freq) {
+		for (size_t i=0; i<frames; i++) {
+			buffer[0] = clip(svfilter_run(data, &data->l, buffer[0], data->tuned_freq, vol));
+			buffer[1] = clip(svfilter_run(data, &data->r, buffer[1], data->tuned_freq, vol));
+			buffer += 2;
+		}
+		return;
+	}
+	
+	// the tuning is looked up in the sine table every frame
+	const int* mod = data->mod_freq + self->block_pos;
+	const int16_t* sine = self->context->tables->sine;
+	for (size_t i=0; i<frames; i++) {
+		int tuned_freq = 2 * sine_lookup(sine, sine_pos(data, mod[i]));
+		buffer[0] = clip(svfilter_run(data, &data->l, buffer[0], tuned_freq, vol));
+		buffer[1] = clip(svfilter_run(data, &data->r, buffer[1], tuned_freq, vol));
+		buffer += 2;
+	}
+}
+
+static inline float svfilter_run_float(filter_data* data, float_state* s, float input, float tuned_freq) {
+	float output = 0;
+	for (int i=0; i<2; i++) {
+		s->lp = s->lp + tuned_freq * s->bp;
+		s->hp = input - s->lp - data->tuned_res_f * s->bp;
+		s->bp = tuned_freq * s->hp + s->bp;
+		s->n = s->hp + s->lp;
+		output += *(float*)((char*)s + data->out);
+	}
+	return output * 0.5f;
+}
+
+static void svfilter_float(nocta_unit* self, float* buffer, size_t length) {
+	filter_data* data = self->data;
+	float vol = data->vol / 256.0f * (data->gain / 65536.0f);
+	
+	if (!data->mod_freq) {
+		for (size_t i=0; i<length; i+=2) {
+			buffer[i] = svfilter_run_float(data, &data->fl, buffer[i], data->tuned_freq_f) * vol;
+			buffer[i+1] = svfilter_run_float(data, &data->fr, buffer[i+1], data->tuned_freq_f) * vol;
+		}
+		return;
+	}
+	
+	const int* mod = data->mod_freq + self->block_pos;
+	const float* sine = self->context->tables->sine_f;
+	for (size_t i=0; i<length; i+=2) {
+		float tuned_freq = 2 * sine_lookup_f(sine, sine_pos(data, mod[i/2]));
+		buffer[i] = svfilter_run_float(data, &data->fl, buffer[i], tuned_freq) * vol;
+		buffer[i+1] = svfilter_run_float(data, &data->fr, buffer[i+1], tuned_freq) * vol;
+	}
+}
+
+static void modulate_freq(nocta_unit* self, const int* values) {
+	filter_data* data = self->data;
+	data->mod_freq = values;
+}
+
+void svfilter_fold(nocta_unit* self, int gain) {
+	filter_data* data = self->data;
+	data->gain = gain;
 }
 
 // getters and setters:
@@ -117,26 +232,20 @@ int get_mode(nocta_unit* self) {
 }
 void set_mode(nocta_unit* self, int mode) {
 	filter_data* data = self->data;
-	filter_state* l = &data->l;
-	filter_state* r = &data->r;
 	data->mode = mode;
 	
 	switch (mode) {
 		case NOCTA_FILTER_MODE_LOWPASS:
-			l->out = &l->lp;
-			r->out = &r->lp;
+			data->out = offsetof(filter_state, lp);
 			break;
 		case NOCTA_FILTER_MODE_HIGHPASS:
-			l->out = &l->hp;
-			r->out = &r->hp;
+			data->out = offsetof(filter_state, hp);
 			break;
 		case NOCTA_FILTER_MODE_BANDPASS:
-			l->out = &l->bp;
-			r->out = &r->bp;
+			data->out = offsetof(filter_state, bp);
 			break;
 		case NOCTA_FILTER_MODE_NOTCH:
-			l->out = &l->n;
-			r->out = &r->n;
+			data->out = offsetof(filter_state, n);
 			break;
 	}
 }
@@ -149,6 +258,7 @@ void set_freq(nocta_unit* self, int freq) {
 	filter_data* data = self->data;
 	data->freq = freq;
 	data->tuned_freq = 2 * fix_sin(FIX_PI * freq / (self->context->sample_rate*2));
+	data->tuned_freq_f = 2 * sin(M_PI * freq / (self->context->sample_rate*2));
 }
 
 int get_res(nocta_unit* self) {
@@ -161,4 +271,5 @@ void set_res(nocta_unit* self, int res) {
 	
 	res -= res/8; // max resonance is too harsh
     data->tuned_res = 2*u8_to_fix(255 - res);
+    data->tuned_res_f = 2 * (255 - res) / 256.0f;
 }
@@ -0,0 +1,31 @@
+#include "common.h"
+#include "tables.h"
+
+struct nocta_tables* get_tables(nocta_context* context) {
+	if (!context->tables) {
+		context->tables = calloc(1, sizeof(struct nocta_tables));
+	}
+	return context->tables;
+}
+
+void nocta_context_free(nocta_context* context) {
+	free(context->events);
+	context->events = NULL;
+	free(context->pool);
+	context->pool = NULL;
+	
+	struct nocta_tables* tables = context->tables;
+	if (!tables) return;
+	free(tables->bqfilter);
+	free(tables->bqfilter_f);
+	free(tables->note_inc);
+	free(tables->sine);
+	free(tables->sine_f);
+	free(tables->hann);
+	free(tables->fft_window);
+	free(tables->fft_cos);
+	free(tables->fft_sin);
+	free(tables->fft_reverse);
+	free(tables);
+	context->tables = NULL;
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include "common.h"
+
+// Lookup tables shared by all the units in a context
+
+// biquad coefficients are tabulated for frequencies on a log scale
+// (with each octave split linearly), and for resonances 0, 32, ... 256
+#define BQ_STEPS_PER_OCTAVE 16
+#define BQ_MIN_OCTAVE 6        // 64 Hz
+#define BQ_MAX_OCTAVE 15       // 32768 Hz
+#define BQ_FREQ_STEPS ((BQ_MAX_OCTAVE - BQ_MIN_OCTAVE) * BQ_STEPS_PER_OCTAVE + 1)
+#define BQ_RES_STEPS 9
+
+// oscillator phase increments for MIDI notes 0 to 128
+// (the extra note is so 127 can be tuned up)
+#define NOTE_TABLE_SIZE 129
+
+// a quarter of a sine wave, from 0 to pi/2
+// (with an extra entry, so the last step can be interpolated)
+#define SINE_BITS 10
+#define SINE_TABLE_SIZE ((1 << SINE_BITS) + 1)
+
+// a periodic Hann window, for overlapping grains by half
+// (with an extra entry, like the sine table)
+#define HANN_BITS 10
+#define HANN_TABLE_SIZE ((1 << HANN_BITS) + 1)
+
+// the analyzer's FFT works on frames of up to 2^FFT_BITS samples
+#define FFT_BITS 12
+#define FFT_SIZE (1 << FFT_BITS)
+
+typedef struct {
+	int16_t b0, b1, b2, a1, a2;  // 3:13, already divided by a0
+} bq_coefs;
+
+typedef struct {
+	float b0, b1, b2, a1, a2;    // for the float backend
+} bq_coefs_f;
+
+struct nocta_tables {
+	// indexed by [mode][resonance step][frequency step]
+	bq_coefs (*bqfilter)[BQ_RES_STEPS][BQ_FREQ_STEPS];
+	bq_coefs_f (*bqfilter_f)[BQ_RES_STEPS][BQ_FREQ_STEPS];
+	
+	// indexed by note, where 2^32 = one cycle per sample
+	uint32_t* note_inc;
+	
+	int16_t* sine;  // 3:13
+	float* sine_f;
+	
+	int16_t* hann;  // 3:13
+	
+	// for the analyzer (see analyzer.c), all for the largest frame size:
+	float* fft_window;        // periodic Hann
+	float* fft_cos;           // twiddle factors for each butterfly size
+	float* fft_sin;
+	uint16_t* fft_reverse;    // bit reversed indices
+};
+
+// get the tables of a context, allocating them the first time
+struct nocta_tables* get_tables(nocta_context* context);
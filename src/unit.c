@@ -1,36 +1,188 @@
 #include "common.h"
 
+// number of samples converted at a time, when 16-bit and float units meet
+#define FLOAT_CHUNK 512
+
 nocta_unit* nocta_create_impl(nocta_unit base) {
 	nocta_unit* unit = malloc(sizeof(nocta_unit));
 	*unit = base;
 	assert(unit->context);
 	assert(unit->process_l);
 	assert(unit->process_r);
+	preset_snapshot(unit);
 	return unit;
 }
 
 void nocta_free(nocta_unit* unit) {
+	nocta_cancel(unit);
+	automation_free(unit);
 	if (unit->free) unit->free(unit); // call a custon free routine
 	if (unit->data) free(unit->data); // free the custom data
+	free(unit->initial_data);
 	free(unit);
 }
 
+// apply a preset that was recalled since the last block
+static inline void update_preset(nocta_unit* unit) {
+	const void* preset = __atomic_load_n(&unit->pending_preset, __ATOMIC_ACQUIRE);
+	if (preset) {
+		preset_apply(unit, preset);
+		// only clear it afterwards, so the owner knows when it's free to reuse
+		__atomic_compare_exchange_n(&unit->pending_preset, &preset, NULL,
+			false, __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+	}
+}
+
+// run a unit's float kernel on 16-bit samples, converting a chunk at a time
+static void run_float_kernel(nocta_unit* unit, int16_t* buffer, size_t length) {
+	float chunk[FLOAT_CHUNK];
+	unsigned int csr = denormals_off();
+	while (length > 0) {
+		size_t n = MIN(length, FLOAT_CHUNK);
+		for (size_t i=0; i<n; i++) chunk[i] = int16_to_float(buffer[i]);
+		unit->process_float(unit, chunk, n);
+		for (size_t i=0; i<n; i++) buffer[i] = float_to_int16(chunk[i]);
+		buffer += n;
+		length -= n;
+		unit->block_pos += n / 2;
+	}
+	denormals_restore(csr);
+}
+
 void nocta_process(nocta_unit* unit, int16_t* l, int16_t* r) {
-	*l = clip(unit->process_l(unit, *l));
-	*r = clip(unit->process_r(unit, *r));
+	RT_ENTER(unit->context->sample_rate, 1);
+	update_automation(unit);
+	update_preset(unit);
+	if (unit->automation) run_automation(unit, 1);
+	run_events(unit, 0, 1);
+	unit->block_pos = 0;
+	if (uses_float(unit)) {
+		// the float state is separate, so stick to the float kernel
+		int16_t frame[2] = { *l, *r };
+		run_float_kernel(unit, frame, 2);
+		*l = frame[0];
+		*r = frame[1];
+	} else {
+		*l = clip(unit->process_l(unit, *l));
+		*r = clip(unit->process_r(unit, *r));
+	}
+	unit->time++;
+	RT_LEAVE();
 }
 
 void nocta_process_mono(nocta_unit* unit, int16_t* l) {
-	*l = clip(unit->process_l(unit, *l));
+	RT_ENTER(unit->context->sample_rate, 1);
+	update_automation(unit);
+	update_preset(unit);
+	if (unit->automation) run_automation(unit, 1);
+	run_events(unit, 0, 1);
+	unit->block_pos = 0;
+	if (uses_float(unit)) {
+		int16_t frame[2] = { *l, 0 };
+		run_float_kernel(unit, frame, 2);
+		*l = frame[0];
+	} else {
+		*l = clip(unit->process_l(unit, *l));
+	}
+	unit->time++;
+	RT_LEAVE();
 }
 
-void nocta_process_buffer(nocta_unit* unit, int16_t* buffer, size_t length) {
+// process part of a block, where nothing is scheduled to happen,
+// moving block_pos on past it
+static void process_span(nocta_unit* unit, int16_t* buffer, size_t length) {
+	if (uses_float(unit)) {
+		run_float_kernel(unit, buffer, length);
+		return;
+	}
+	if (unit->process_buffer) {
+		unit->process_buffer(unit, buffer, length);
+		unit->block_pos += length / 2;
+		return;
+	}
 	for (int i=0; i<length/2; i++) {
 		*buffer = clip(unit->process_l(unit, *buffer));
 		buffer++;
 		*buffer = clip(unit->process_r(unit, *buffer));
 		buffer++;
+		unit->block_pos++;
+	}
+}
+
+static void process_block(nocta_unit* unit, int16_t* buffer, size_t length) {
+	update_preset(unit);
+	if (unit->automation) run_automation(unit, length / 2);
+	
+	// split the block wherever an event is due
+	size_t frames = length / 2;
+	size_t pos = 0;
+	while (pos < frames) {
+		size_t next = run_events(unit, pos, frames);
+		unit->block_pos = pos;
+		process_span(unit, buffer + pos*2, (next - pos) * 2);
+		pos = next;
+	}
+	unit->time += frames;
+}
+
+void nocta_process_buffer(nocta_unit* unit, int16_t* buffer, size_t length) {
+	RT_ENTER(unit->context->sample_rate, length / 2);
+	update_automation(unit);
+	// automation is worked out a limited number of frames at a time
+	while (unit->automation && length > AUTOMATION_FRAMES*2) {
+		process_block(unit, buffer, AUTOMATION_FRAMES*2);
+		buffer += AUTOMATION_FRAMES*2;
+		length -= AUTOMATION_FRAMES*2;
+	}
+	process_block(unit, buffer, length);
+	RT_LEAVE();
+}
+
+// process part of a float block, where nothing is scheduled to happen
+static void process_span_f(nocta_unit* unit, float* buffer, size_t length) {
+	if (uses_float(unit)) {
+		unsigned int csr = denormals_off();
+		unit->process_float(unit, buffer, length);
+		denormals_restore(csr);
+		return;
+	}
+	// units without a float kernel work on 16-bit copies
+	int16_t chunk[FLOAT_CHUNK];
+	while (length > 0) {
+		size_t n = MIN(length, FLOAT_CHUNK);
+		for (size_t i=0; i<n; i++) chunk[i] = float_to_int16(buffer[i]);
+		process_span(unit, chunk, n);
+		for (size_t i=0; i<n; i++) buffer[i] = int16_to_float(chunk[i]);
+		buffer += n;
+		length -= n;
+	}
+}
+
+static void process_block_f(nocta_unit* unit, float* buffer, size_t length) {
+	update_preset(unit);
+	if (unit->automation) run_automation(unit, length / 2);
+	
+	size_t frames = length / 2;
+	size_t pos = 0;
+	while (pos < frames) {
+		size_t next = run_events(unit, pos, frames);
+		unit->block_pos = pos;
+		process_span_f(unit, buffer + pos*2, (next - pos) * 2);
+		pos = next;
 	}
+	unit->time += frames;
+}
+
+void nocta_process_float(nocta_unit* unit, float* buffer, size_t length) {
+	RT_ENTER(unit->context->sample_rate, length / 2);
+	update_automation(unit);
+	while (unit->automation && length > AUTOMATION_FRAMES*2) {
+		process_block_f(unit, buffer, AUTOMATION_FRAMES*2);
+		buffer += AUTOMATION_FRAMES*2;
+		length -= AUTOMATION_FRAMES*2;
+	}
+	process_block_f(unit, buffer, length);
+	RT_LEAVE();
 }
 
 int nocta_get(nocta_unit* unit, int param_id) {
@@ -47,6 +199,25 @@ void nocta_set(nocta_unit* unit, int param_id, int val) {
 	param->set(unit, val);
 }
 
+bool nocta_modulate(nocta_unit* unit, int param_id, const int* values) {
+	if (param_id >= unit->num_params || !unit->params[param_id].modulate)
+		return false;
+	unit->params[param_id].modulate(unit, values);
+	return true;
+}
+
+bool nocta_note_on(nocta_unit* unit, int note) {
+	if (!unit->note) return false;
+	unit->note(unit, note, true);
+	return true;
+}
+
+bool nocta_note_off(nocta_unit* unit, int note) {
+	if (!unit->note) return false;
+	unit->note(unit, note, false);
+	return true;
+}
+
 nocta_param* nocta_get_param(nocta_unit* unit, int param_id) {
 	return param_id < unit->num_params ? &unit->params[param_id] : NULL;
 }
@@ -1,11 +1,62 @@
 #include "common.h"
 #include "utils.h"
+#include "tables.h"
 
-#define TWELTH_ROOT_2 (int32_t)(1.059463094359 * FIX_1)
-// base note is F4 (440 Hz)
+// base note is A4 (440 Hz)
 #define BASE_FREQ 440
-#define BASE_NOTE 53
+#define BASE_NOTE 69
 
-int note_to_freq(int key) {
+static double note_to_freq_exact(double key) {
+	return BASE_FREQ * pow(2, (key - BASE_NOTE) / 12);
+}
+
+void build_note_table(nocta_context* context) {
+	struct nocta_tables* tables = get_tables(context);
+	if (tables->note_inc) return;
+	
+	tables->note_inc = malloc(NOTE_TABLE_SIZE * sizeof(uint32_t));
+	for (int key=0; key<NOTE_TABLE_SIZE; key++) {
+		// anything above the Nyquist frequency would alias anyway
+		double cycles = MIN(note_to_freq_exact(key) / context->sample_rate, 0.5);
+		tables->note_inc[key] = cycles * 4294967296.0;
+	}
+}
+
+uint32_t note_to_phase_inc(nocta_context* context, int key, int fine) {
+	uint32_t* table = context->tables->note_inc;
+	
+	// position between two semitones in 1/256ths
+	int pos = key * 256 + fine * 256 / 100;
+	pos = CLAMP(pos, 0, (NOTE_TABLE_SIZE-1) * 256);
+	int i = pos >> 8;
+	int t = pos & 0xff;
+	if (t == 0) return table[i];
+	return table[i] + ((uint64_t)(table[i+1] - table[i]) * t >> 8);
+}
+
+void build_sine_table(nocta_context* context) {
+	struct nocta_tables* tables = get_tables(context);
+	if (tables->sine) return;
+	
+	tables->sine = malloc(SINE_TABLE_SIZE * sizeof(int16_t));
+	tables->sine_f = malloc(SINE_TABLE_SIZE * sizeof(float));
+	for (int i=0; i<SINE_TABLE_SIZE; i++) {
+		double y = sin(M_PI / 2 * i / (SINE_TABLE_SIZE - 1));
+		tables->sine[i] = y * FIX_1 + 0.5;
+		tables->sine_f[i] = y;
+	}
+}
+
+void build_hann_table(nocta_context* context) {
+	struct nocta_tables* tables = get_tables(context);
+	if (tables->hann) return;
 	
-}
\ No newline at end of file
+	// two windows half a period apart add up to exactly 1.0
+	tables->hann = malloc(HANN_TABLE_SIZE * sizeof(int16_t));
+	for (int i=0; i<HANN_TABLE_SIZE/2; i++) {
+		double y = 0.5 - 0.5 * cos(2 * M_PI * i / (HANN_TABLE_SIZE - 1));
+		tables->hann[i] = y * FIX_1 + 0.5;
+		tables->hann[i + HANN_TABLE_SIZE/2] = FIX_1 - tables->hann[i];
+	}
+	tables->hann[HANN_TABLE_SIZE-1] = 0;
+}
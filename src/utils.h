@@ -1,5 +1,28 @@
 #pragma once
 #include "common.h"
+#include "tables.h"
 
-// get the frequency of a note in hertz
-int note_to_freq(int key);
+// fill in the phase increment table for this context, if it's not been done yet
+void build_note_table(nocta_context* context);
+
+// how far an oscillator should advance each sample to play a note, where
+// 2^32 = one cycle, and fine tuning is in cents (from -100 to 100)
+uint32_t note_to_phase_inc(nocta_context* context, int key, int fine);
+
+// fill in the sine tables for this context, if it's not been done yet
+void build_sine_table(nocta_context* context);
+
+// fill in the Hann window for this context, if it's not been done yet
+void build_hann_table(nocta_context* context);
+
+// sin(x * pi/2), for x from 0 up to (not including) 1.0 in 16:16, from a sine table
+inline static int sine_lookup(const int16_t* table, int x) {
+	int i = x >> (16 - SINE_BITS);
+	int t = x & ((1 << (16 - SINE_BITS)) - 1);
+	return table[i] + ((table[i+1] - table[i]) * t >> (16 - SINE_BITS));
+}
+inline static float sine_lookup_f(const float* table, int x) {
+	int i = x >> (16 - SINE_BITS);
+	float t = (x & ((1 << (16 - SINE_BITS)) - 1)) * (1.0f / (1 << (16 - SINE_BITS)));
+	return table[i] + (table[i+1] - table[i]) * t;
+}
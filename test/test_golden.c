@@ -0,0 +1,1089 @@
+// Headless regression test: renders fixed input signals through every unit
+// and mode, and compares a checksum of each output against golden.txt.
+// The time taken by each render is printed alongside, so optimisations can
+// be checked for both speed and identical output.
+//
+// usage:
+//   test_golden [golden.txt]            check against the stored checksums
+//   test_golden --update [golden.txt]   store new checksums
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include "nocta.h"
+
+#define SAMPLE_RATE 44100
+#define FRAMES SAMPLE_RATE   // one second of each signal
+#define BLOCK 256            // frames per nocta_process_buffer call
+#define MAX_CASES 256
+#define RT_LOAD_BUDGET 0.5   // most of a block's length any processing call may take
+
+typedef nocta_unit* (*create_cb)(nocta_context* context);
+
+typedef struct {
+	char name[64];
+	uint64_t checksum;
+	double seconds;
+	int voices;        // for sequences, the number of voices rendered at once
+} result;
+
+static nocta_context context = { .sample_rate = SAMPLE_RATE };
+static nocta_context float_context = { .sample_rate = SAMPLE_RATE, .backend = NOCTA_BACKEND_FLOAT };
+static result results[MAX_CASES];
+static int num_results;
+
+static int16_t input[FRAMES*2];
+static int16_t output[FRAMES*2];
+
+
+// input signals:
+
+enum { SIGNAL_IMPULSE, SIGNAL_SWEEP, SIGNAL_NOISE, NUM_SIGNALS };
+static const char* signal_names[] = { "impulse", "sweep", "noise" };
+
+static void make_signal(int signal) {
+	memset(input, 0, sizeof(input));
+	switch (signal) {
+		case SIGNAL_IMPULSE:
+			input[0] = input[1] = 30000;
+			break;
+		case SIGNAL_SWEEP: {
+			// parabolic sine approximation, so the input doesn't depend on libm
+			uint32_t phase = 0;
+			for (int i=0; i<FRAMES; i++) {
+				uint64_t freq = 20 + (uint64_t)i * 20000 / FRAMES;
+				phase += (freq << 32) / SAMPLE_RATE;
+				int x = (int32_t)phase >> 16;          // -32768..32767
+				int y = 2 * x - (int)(2 * (int64_t)x * abs(x) >> 15); // roughly sin
+				input[i*2] = y * 3 / 4;
+				input[i*2+1] = -y * 3 / 4;
+			}
+			break;
+		}
+		case SIGNAL_NOISE: {
+			uint32_t state = 12345;
+			for (int i=0; i<FRAMES*2; i++) {
+				state ^= state << 13;
+				state ^= state >> 17;
+				state ^= state << 5;
+				input[i] = (int32_t)state >> 17;
+			}
+			break;
+		}
+	}
+}
+
+// FNV-1a
+static uint64_t checksum(const int16_t* samples, size_t length) {
+	uint64_t hash = 14695981039346656037ull;
+	const uint8_t* bytes = (const uint8_t*)samples;
+	for (size_t i=0; i<length*2; i++) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+static double now(void) {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+
+// test cases:
+
+static void store_result(const char* name, int signal, double seconds) {
+	result* r = &results[num_results++];
+	snprintf(r->name, sizeof(r->name), "%s/%s", name, signal_names[signal]);
+	r->checksum = checksum(output, FRAMES*2);
+	r->seconds = seconds;
+}
+
+// render every input signal through a unit, after applying some settings
+static void run_case(nocta_context* context, const char* name, create_cb create,
+                     const int* settings, int num_settings) {
+	for (int signal=0; signal<NUM_SIGNALS; signal++) {
+		nocta_unit* unit = create(context);
+		for (int i=0; i<num_settings; i+=2) {
+			nocta_set(unit, settings[i], settings[i+1]);
+		}
+		if (strcmp(unit->name, "noise") == 0) nocta_noise_seed(unit, 1);
+		if (strcmp(unit->name, "osc") == 0) nocta_osc_seed(unit, 1);
+
+		make_signal(signal);
+		memcpy(output, input, sizeof(output));
+
+		double start = now();
+		for (int i=0; i<FRAMES; i+=BLOCK) {
+			int frames = FRAMES - i < BLOCK ? FRAMES - i : BLOCK;
+			nocta_process_buffer(unit, output + i*2, frames*2);
+		}
+		double seconds = now() - start;
+
+		store_result(name, signal, seconds);
+		nocta_free(unit);
+	}
+}
+
+// settings are pairs of parameter ids and values
+#define CASE(name, create, ...) \
+	run_case(&context, name, create, (int[]){ __VA_ARGS__ }, sizeof((int[]){ __VA_ARGS__ })/sizeof(int))
+
+// the same, using the float backend
+#define FLOAT_CASE(name, create, ...) \
+	run_case(&float_context, "float_" name, create, (int[]){ __VA_ARGS__ }, sizeof((int[]){ __VA_ARGS__ })/sizeof(int))
+
+// render every input signal through a unit, with a parameter following a
+// triangle wave between `low` and `high` at audio rate
+static void run_mod_case(nocta_context* context, const char* name, create_cb create,
+                         int param, int low, int high) {
+	static int mod[BLOCK];
+	const int period = 11025;
+	for (int signal=0; signal<NUM_SIGNALS; signal++) {
+		nocta_unit* unit = create(context);
+		nocta_modulate(unit, param, mod);
+
+		make_signal(signal);
+		memcpy(output, input, sizeof(output));
+
+		double start = now();
+		for (int i=0; i<FRAMES; i+=BLOCK) {
+			int frames = FRAMES - i < BLOCK ? FRAMES - i : BLOCK;
+			for (int j=0; j<frames; j++) {
+				int t = (i + j) % period;
+				int tri = t < period/2 ? t : period - t;
+				mod[j] = low + (high - low) * tri / (period/2);
+			}
+			nocta_process_buffer(unit, output + i*2, frames*2);
+		}
+		double seconds = now() - start;
+
+		store_result(name, signal, seconds);
+		nocta_free(unit);
+	}
+}
+
+typedef struct {
+	int param;
+	const nocta_breakpoint* points;
+	int count;
+} lane;
+
+// render every input signal through a unit, with some of its parameters
+// automated, and check that handing over a new set of lanes halfway through
+// (copies of the same ones, with a lane that wasn't there taken off) carries
+// on from where they were
+#define LANE_HANDOVER (FRAMES/2 / BLOCK * BLOCK)
+
+static double render_lanes(nocta_context* context, create_cb create, const lane* lanes,
+                           int num_lanes, bool handover, int16_t* buffer) {
+	nocta_unit* unit = create(context);
+	for (int i=0; i<num_lanes; i++) {
+		nocta_automate(unit, lanes[i].param, lanes[i].points, lanes[i].count);
+	}
+	int unused = 0;
+	for (int i=0; i<num_lanes; i++) {
+		if (lanes[i].param == unused) { unused++; i = -1; }
+	}
+
+	memcpy(buffer, input, sizeof(input));
+	double start = now();
+	for (int i=0; i<FRAMES; i+=BLOCK) {
+		int frames = FRAMES - i < BLOCK ? FRAMES - i : BLOCK;
+		if (handover && i == LANE_HANDOVER) nocta_automate(unit, unused, NULL, 0);
+		nocta_process_buffer(unit, buffer + i*2, frames*2);
+	}
+	double seconds = now() - start;
+	nocta_free(unit);
+	return seconds;
+}
+
+static void run_lane_case(nocta_context* context, const char* name, create_cb create,
+                          const lane* lanes, int num_lanes) {
+	static int16_t handed_over[FRAMES*2];
+	for (int signal=0; signal<NUM_SIGNALS; signal++) {
+		make_signal(signal);
+		double seconds = render_lanes(context, create, lanes, num_lanes, false, output);
+		render_lanes(context, create, lanes, num_lanes, true, handed_over);
+		if (memcmp(output, handed_over, sizeof(output)) != 0) {
+			fprintf(stderr, "%s/%s: the lanes didn't carry on when handed over\n",
+			        name, signal_names[signal]);
+			exit(1);
+		}
+		store_result(name, signal, seconds);
+	}
+}
+
+#define LANE(param, ...) \
+	{ param, (nocta_breakpoint[]){ __VA_ARGS__ }, sizeof((nocta_breakpoint[]){ __VA_ARGS__ })/sizeof(nocta_breakpoint) }
+
+// render every input signal through a bqfilter, recalling a preset built
+// from a list of values (the same whichever filter builds it) a quarter of
+// the way through, and one captured from
+// another filter halfway through, and check the output is the same as that
+// of a filter whose parameters are set at those points instead
+static void run_preset_case(nocta_context* context, const char* name) {
+	static int16_t reference[FRAMES*2];
+	const int values[] = { 200, NOCTA_FILTER_MODE_HIGHPASS, 1200, 60 };
+	for (int signal=0; signal<NUM_SIGNALS; signal++) {
+		nocta_unit* unit = nocta_bqfilter(context);
+		nocta_unit* source = nocta_bqfilter(context);
+		nocta_set(source, NOCTA_FILTER_MODE, NOCTA_FILTER_MODE_BANDPASS);
+		nocta_set(source, NOCTA_FILTER_FREQ, 500);
+		nocta_set(source, NOCTA_FILTER_RES, 150);
+
+		size_t size = nocta_preset_size(unit);
+		void* prepared = malloc(size);
+		void* captured = malloc(size);
+		void* fresh = malloc(size);
+		nocta_preset_prepare(unit, prepared, values);
+		nocta_preset_capture(source, captured);
+		for (int i=0; i<NOCTA_FILTER_NUM_PARAMS; i++) {
+			if (nocta_preset_get(prepared, i) != values[i]) {
+				fprintf(stderr, "%s: prepared preset has the wrong values\n", name);
+				exit(1);
+			}
+		}
+		// preparing doesn't depend on the unit's current settings
+		nocta_preset_prepare(source, fresh, values);
+		if (memcmp(prepared, fresh, size) != 0) {
+			fprintf(stderr, "%s: prepared preset depends on the unit's settings\n", name);
+			exit(1);
+		}
+		free(fresh);
+
+		// a preset only fits units of the same kind, and has to be complete
+		nocta_unit* gainer = nocta_gainer(context);
+		if (!nocta_preset_check(unit, captured, size) || nocta_preset_check(gainer, captured, size)
+		    || nocta_preset_check(unit, captured, size - 1)) {
+			fprintf(stderr, "%s: presets weren't checked properly\n", name);
+			exit(1);
+		}
+		nocta_free(gainer);
+
+		make_signal(signal);
+		memcpy(output, input, sizeof(output));
+		memcpy(reference, input, sizeof(reference));
+		nocta_unit* set = nocta_bqfilter(context);
+
+		double start = now();
+		for (int i=0; i<FRAMES; i+=BLOCK) {
+			int frames = FRAMES - i < BLOCK ? FRAMES - i : BLOCK;
+			if (i == FRAMES/4 / BLOCK * BLOCK) nocta_preset_recall(unit, prepared);
+			if (i == FRAMES/2 / BLOCK * BLOCK) nocta_preset_recall(unit, captured);
+			nocta_process_buffer(unit, output + i*2, frames*2);
+			if (nocta_preset_pending(unit)) {
+				fprintf(stderr, "%s: preset wasn't applied\n", name);
+				exit(1);
+			}
+		}
+		double seconds = now() - start;
+
+		for (int i=0; i<FRAMES; i+=BLOCK) {
+			int frames = FRAMES - i < BLOCK ? FRAMES - i : BLOCK;
+			if (i == FRAMES/4 / BLOCK * BLOCK) {
+				for (int p=0; p<NOCTA_FILTER_NUM_PARAMS; p++) nocta_set(set, p, values[p]);
+			}
+			if (i == FRAMES/2 / BLOCK * BLOCK) {
+				for (int p=0; p<NOCTA_FILTER_NUM_PARAMS; p++) nocta_set(set, p, nocta_get(source, p));
+			}
+			nocta_process_buffer(set, reference + i*2, frames*2);
+		}
+
+		if (memcmp(output, reference, sizeof(output)) != 0) {
+			fprintf(stderr, "%s/%s: recalling presets didn't match setting the parameters\n",
+			        name, signal_names[signal]);
+			exit(1);
+		}
+		if (nocta_get(unit, NOCTA_FILTER_FREQ) != 500) {
+			fprintf(stderr, "%s: the captured preset wasn't recalled\n", name);
+			exit(1);
+		}
+		store_result(name, signal, seconds);
+		free(prepared);
+		free(captured);
+		nocta_free(unit);
+		nocta_free(source);
+		nocta_free(set);
+	}
+}
+
+// meter a full scale square wave on the left and a half scale one on the
+// right, then a sine wave, a period at a time (and also frame by frame),
+// checking the levels published after each period, and store them all
+#define METER_PERIOD 441   // 10 ms
+#define METER_PERIODS 100
+
+static void check_levels(const char* name, const nocta_meter_levels* levels, const nocta_meter_levels* expected) {
+	if (abs(levels->peak_l - expected->peak_l) > 1 || abs(levels->peak_r - expected->peak_r) > 1
+	    || abs(levels->rms_l - expected->rms_l) > 2 || abs(levels->rms_r - expected->rms_r) > 2
+	    || levels->clips != expected->clips || levels->count != expected->count) {
+		fprintf(stderr, "%s: measured peak %d %d, rms %d %d, %u clips, count %u\n"
+		        "  instead of peak %d %d, rms %d %d, %u clips, count %u\n", name,
+		        levels->peak_l, levels->peak_r, levels->rms_l, levels->rms_r, levels->clips, levels->count,
+		        expected->peak_l, expected->peak_r, expected->rms_l, expected->rms_r, expected->clips, expected->count);
+		exit(1);
+	}
+}
+
+static void run_meter_case(nocta_context* context, const char* name) {
+	nocta_unit* meter = nocta_meter(context);
+	nocta_unit* framewise = nocta_meter(context);
+	nocta_set(meter, NOCTA_METER_PERIOD, METER_PERIOD * 1000 / SAMPLE_RATE);
+	nocta_set(framewise, NOCTA_METER_PERIOD, METER_PERIOD * 1000 / SAMPLE_RATE);
+
+	for (int i=0; i<METER_PERIODS*METER_PERIOD; i++) {
+		if (i < METER_PERIODS/2 * METER_PERIOD) {
+			bool high = i / 49 % 2 == 0;
+			input[i*2] = high ? 32767 : -32767;
+			input[i*2+1] = high ? 16384 : -16384;
+		} else {
+			// exactly 9 cycles a period
+			input[i*2] = input[i*2+1] = lrint(20000 * sin(2 * M_PI * 9 * i / METER_PERIOD));
+		}
+	}
+	memcpy(output, input, sizeof(output));
+
+	nocta_meter_levels levels[METER_PERIODS];
+	double seconds = 0;
+	for (int p=0; p<METER_PERIODS; p++) {
+		int16_t* block = output + p*METER_PERIOD*2;
+		double start = now();
+		nocta_process_buffer(meter, block, METER_PERIOD*2);
+		seconds += now() - start;
+		nocta_meter_read(meter, &levels[p]);
+
+		nocta_meter_levels expected;
+		if (p < METER_PERIODS/2) {
+			expected = (nocta_meter_levels){ 32767, 16384, 32767, 16384, (p+1) * METER_PERIOD, p+1 };
+		} else {
+			// the samples don't fall on the sine's peaks
+			int peak = 0;
+			for (int i=0; i<METER_PERIOD*2; i++) {
+				int x = abs(input[p*METER_PERIOD*2 + i]);
+				if (x > peak) peak = x;
+			}
+			expected = (nocta_meter_levels){ peak, peak, 14142, 14142, METER_PERIODS/2 * METER_PERIOD, p+1 };
+		}
+		check_levels(name, &levels[p], &expected);
+
+		for (int i=0; i<METER_PERIOD; i++) {
+			int16_t l = input[(p*METER_PERIOD + i) * 2];
+			int16_t r = input[(p*METER_PERIOD + i) * 2 + 1];
+			nocta_process(framewise, &l, &r);
+		}
+		nocta_meter_levels framewise_levels;
+		nocta_meter_read(framewise, &framewise_levels);
+		check_levels(name, &framewise_levels, &levels[p]);
+	}
+	if (memcmp(output, input, METER_PERIODS*METER_PERIOD*2 * sizeof(int16_t)) != 0) {
+		fprintf(stderr, "%s: the sound was changed\n", name);
+		exit(1);
+	}
+
+	result* r = &results[num_results++];
+	snprintf(r->name, sizeof(r->name), "%s", name);
+	r->checksum = checksum((int16_t*)levels, sizeof(levels) / sizeof(int16_t));
+	r->seconds = seconds;
+	nocta_free(meter);
+	nocta_free(framewise);
+}
+
+// render a loud impulse and noise through a limiter with makeup gain, checking
+// that once the lookahead has passed, nothing comes out above the threshold
+// (plus the makeup gain), and store the outputs
+#define LIMITER_THRESHOLD 12   // dB
+#define LIMITER_GAIN 6         // dB
+#define LIMITER_TOLERANCE 1.02 // the gain is worked out in fixed point log2
+
+static void run_limiter_case(nocta_context* context, const char* name) {
+	int signals[] = { SIGNAL_IMPULSE, SIGNAL_NOISE };
+	double ceiling = INT16_MAX * pow(10, (LIMITER_GAIN - LIMITER_THRESHOLD) / 20.0) * LIMITER_TOLERANCE;
+
+	for (int s=0; s<2; s++) {
+		nocta_unit* limiter = nocta_limiter(context);
+		nocta_set(limiter, NOCTA_DYNAMICS_THRESHOLD, LIMITER_THRESHOLD);
+		nocta_set(limiter, NOCTA_DYNAMICS_GAIN, LIMITER_GAIN);
+		int lookahead = nocta_get(limiter, NOCTA_DYNAMICS_LOOKAHEAD) * SAMPLE_RATE / 1000;
+
+		make_signal(signals[s]);
+		if (signals[s] == SIGNAL_NOISE) {
+			// full scale
+			for (int i=0; i<FRAMES*2; i++) input[i] = input[i] * 2 + (input[i] < 0);
+		}
+		memcpy(output, input, sizeof(output));
+
+		double start = now();
+		for (int i=0; i<FRAMES; i+=BLOCK) {
+			int frames = FRAMES - i < BLOCK ? FRAMES - i : BLOCK;
+			nocta_process_buffer(limiter, output + i*2, frames*2);
+		}
+		double seconds = now() - start;
+
+		int peak = 0;
+		for (int i=lookahead*2; i<FRAMES*2; i++) {
+			if (abs(output[i]) > peak) peak = abs(output[i]);
+			if (abs(output[i]) > ceiling) {
+				fprintf(stderr, "%s/%s: %d at frame %d is over the ceiling of %.0f\n",
+				        name, signal_names[signals[s]], output[i], i/2, ceiling);
+				exit(1);
+			}
+		}
+		if (peak < ceiling / 2) {
+			fprintf(stderr, "%s/%s: peak of %d is well under the ceiling of %.0f\n",
+			        name, signal_names[signals[s]], peak, ceiling);
+			exit(1);
+		}
+
+		store_result(name, signals[s], seconds);
+		nocta_free(limiter);
+	}
+}
+
+// render every input signal through a small graph:
+//   input -> bqfilter -> delay -> output
+//   input -> reverb -> mix -> output
+//   osc ----------------^
+static void run_graph_case(nocta_context* context, const char* name) {
+	for (int signal=0; signal<NUM_SIGNALS; signal++) {
+		nocta_unit* units[] = {
+			nocta_bqfilter(context), nocta_delay(context), nocta_reverb(context), nocta_osc(context)
+		};
+		nocta_set(units[0], NOCTA_FILTER_FREQ, 3000);
+		nocta_set(units[1], NOCTA_DELAY_TIME, 20);
+		nocta_osc_seed(units[3], 1);
+		nocta_osc_note(units[3], 45);
+
+		nocta_graph* graph = nocta_graph_create(context);
+		int filter = nocta_graph_add(graph, units[0]);
+		int delay = nocta_graph_add(graph, units[1]);
+		int reverb = nocta_graph_add(graph, units[2]);
+		int osc = nocta_graph_add(graph, units[3]);
+		int mix = nocta_graph_add(graph, NULL);
+		nocta_graph_connect(graph, NOCTA_GRAPH_INPUT, filter);
+		nocta_graph_connect(graph, filter, delay);
+		nocta_graph_connect(graph, delay, NOCTA_GRAPH_OUTPUT);
+		nocta_graph_connect(graph, NOCTA_GRAPH_INPUT, reverb);
+		nocta_graph_connect(graph, reverb, mix);
+		nocta_graph_connect(graph, osc, mix);
+		nocta_graph_connect(graph, mix, NOCTA_GRAPH_OUTPUT);
+		if (!nocta_graph_build(graph, BLOCK*2)) {
+			fprintf(stderr, "%s: graph didn't build\n", name);
+			exit(1);
+		}
+
+		make_signal(signal);
+		memcpy(output, input, sizeof(output));
+
+		double start = now();
+		for (int i=0; i<FRAMES; i+=BLOCK) {
+			int frames = FRAMES - i < BLOCK ? FRAMES - i : BLOCK;
+			nocta_graph_process(graph, output + i*2, frames*2);
+		}
+		double seconds = now() - start;
+
+		store_result(name, signal, seconds);
+		nocta_graph_free(graph);
+		for (int i=0; i<4; i++) nocta_free(units[i]);
+	}
+}
+
+// render the input through chains that a compiled graph fuses:
+//   input -> gainer -> gainer -> svfilter -> output
+//   input -> gainer (panned) -> gainer -> output
+// changing the first gainer of each run while the second one is modulated
+// (so the runs can't be fused, and the filter's fold is undone), then
+// stopping the modulation, and later changing a volume and scheduling another,
+// and finally turning the filter's run right down
+#define FUSED_MODULATED (FRAMES/4 / BLOCK * BLOCK)
+#define FUSED_UNMODULATED (FUSED_MODULATED + BLOCK*20)
+#define FUSED_CHANGED (FRAMES/2 / BLOCK * BLOCK)
+#define FUSED_QUIET (FRAMES*3/4 / BLOCK * BLOCK)
+#define FUSED_SETTLE 64      // frames for the filter to settle after its fold changes
+#define FUSED_TOLERANCE 12   // the unfused gainers each round down, and the resonance amplifies it
+
+static double render_fused(nocta_context* context, const char* name, bool compile, int16_t* buffer) {
+	static int mod[BLOCK];
+	nocta_unit* units[] = {
+		nocta_gainer(context), nocta_gainer(context), nocta_svfilter(context),
+		nocta_gainer(context), nocta_gainer(context)
+	};
+	nocta_set(units[0], NOCTA_GAINER_VOL, 100);
+	nocta_set(units[1], NOCTA_GAINER_VOL, 90);
+	nocta_set(units[2], NOCTA_FILTER_FREQ, 3000);
+	nocta_set(units[2], NOCTA_FILTER_RES, 100);
+	nocta_set(units[3], NOCTA_GAINER_PAN, -60);
+	nocta_set(units[4], NOCTA_GAINER_VOL, 60);
+
+	nocta_graph* graph = nocta_graph_create(context);
+	int prev = NOCTA_GRAPH_INPUT;
+	for (int i=0; i<3; i++) {
+		int node = nocta_graph_add(graph, units[i]);
+		nocta_graph_connect(graph, prev, node);
+		prev = node;
+	}
+	nocta_graph_connect(graph, prev, NOCTA_GRAPH_OUTPUT);
+	prev = NOCTA_GRAPH_INPUT;
+	for (int i=3; i<5; i++) {
+		int node = nocta_graph_add(graph, units[i]);
+		nocta_graph_connect(graph, prev, node);
+		prev = node;
+	}
+	nocta_graph_connect(graph, prev, NOCTA_GRAPH_OUTPUT);
+	if (!(compile ? nocta_graph_compile : nocta_graph_build)(graph, BLOCK*2)) {
+		fprintf(stderr, "%s: graph didn't build\n", name);
+		exit(1);
+	}
+
+	memcpy(buffer, input, sizeof(input));
+	double start = now();
+	for (int i=0; i<FRAMES; i+=BLOCK) {
+		int frames = FRAMES - i < BLOCK ? FRAMES - i : BLOCK;
+		if (i == FUSED_MODULATED) {
+			nocta_modulate(units[1], NOCTA_GAINER_VOL, mod);
+			nocta_modulate(units[4], NOCTA_GAINER_VOL, mod);
+			nocta_set(units[0], NOCTA_GAINER_VOL, 120);
+			nocta_set(units[3], NOCTA_GAINER_VOL, 150);
+		}
+		if (i == FUSED_UNMODULATED) {
+			nocta_modulate(units[1], NOCTA_GAINER_VOL, NULL);
+			nocta_modulate(units[4], NOCTA_GAINER_VOL, NULL);
+		}
+		if (i == FUSED_CHANGED) {
+			nocta_set(units[1], NOCTA_GAINER_VOL, 180);
+			nocta_schedule(units[4], 100, NOCTA_GAINER_VOL, 120);
+		}
+		if (i == FUSED_QUIET)
+			nocta_set(units[0], NOCTA_GAINER_VOL, 2);
+		for (int j=0; j<frames; j++) mod[j] = 60 + (i + j) % 64;
+		nocta_graph_process(graph, buffer + i*2, frames*2);
+	}
+	double seconds = now() - start;
+
+	nocta_graph_free(graph);
+	for (int i=0; i<5; i++) nocta_free(units[i]);
+	return seconds;
+}
+
+// render every input signal through the chains compiled, and check the
+// output matches the same graph built without fusing, apart from rounding
+// (and a short difference where a gain folded into the filter changes, as
+// it then changes the filter's volume rather than its input)
+static void run_fused_case(nocta_context* context, const char* name) {
+	static int16_t reference[FRAMES*2];
+	const int changes[] = { FUSED_MODULATED, FUSED_UNMODULATED, FUSED_CHANGED, FUSED_QUIET };
+	for (int signal=0; signal<NUM_SIGNALS; signal++) {
+		make_signal(signal);
+		render_fused(context, name, false, reference);
+		double seconds = render_fused(context, name, true, output);
+
+		for (int i=0; i<FRAMES; i++) {
+			bool settling = false;
+			for (int j=0; j<4; j++) {
+				if (i >= changes[j] && i < changes[j] + FUSED_SETTLE) settling = true;
+			}
+			for (int c=0; c<2 && !settling; c++) {
+				int diff = abs(output[i*2+c] - reference[i*2+c]);
+				if (diff > FUSED_TOLERANCE) {
+					fprintf(stderr, "%s/%s: frame %d is %d off from the unfused graph\n",
+					        name, signal_names[signal], i, diff);
+					exit(1);
+				}
+			}
+		}
+		store_result(name, signal, seconds);
+	}
+}
+
+// render a sequence of notes and filter sweeps on SEQ_TRACKS tracks of
+// osc -> svfilter -> gainer, in large blocks as an offline render would,
+// or on a render-ahead stream, read a device-sized block at a time
+#define SEQ_TRACKS 32
+#define SEQ_BLOCK 4096
+#define DEVICE_BLOCK 512
+
+static void render_seq(void* seq, int16_t* buffer, size_t length) {
+	nocta_seq_render(seq, buffer, length);
+}
+
+static void run_seq_case(nocta_context* context, const char* name, bool ahead) {
+	static nocta_seq_event events[SEQ_TRACKS * 64];
+	int count = 0;
+	for (int step=0; step<32; step++) {
+		for (int track=0; track<SEQ_TRACKS; track++) {
+			uint32_t time = step * 1378 + track * 7;
+			int note = 36 + (step * 5 + track * 7) % 48;
+			events[count++] = (nocta_seq_event){ time, note, track, NOCTA_SEQ_NOTE_ON };
+			events[count++] = (nocta_seq_event){ time, 300 + (step * 997 + track * 131) % 6000,
+				track, NOCTA_SEQ_SET(1, NOCTA_FILTER_FREQ) };
+		}
+	}
+
+	nocta_unit* units[SEQ_TRACKS][3];
+	nocta_seq* seq = nocta_seq_create(context);
+	for (int track=0; track<SEQ_TRACKS; track++) {
+		units[track][0] = nocta_osc(context);
+		units[track][1] = nocta_svfilter(context);
+		units[track][2] = nocta_gainer(context);
+		nocta_osc_seed(units[track][0], track);
+		nocta_set(units[track][0], NOCTA_OSC_WAVE, track % 4 == 1 ? NOCTA_WAVE_SQUARE : NOCTA_WAVE_SAW);
+		nocta_set(units[track][1], NOCTA_FILTER_RES, 120);
+		nocta_set(units[track][2], NOCTA_GAINER_VOL, 24);
+		nocta_set(units[track][2], NOCTA_GAINER_PAN, (track * 37) % 255 - 127);
+		nocta_seq_track(seq, units[track], 3);
+	}
+	nocta_seq_play(seq, events, count, true);
+
+	memset(output, 0, sizeof(output));
+	double start = now();
+	if (ahead) {
+		nocta_stream* stream = nocta_stream_start(context, render_seq, seq, SEQ_BLOCK, 4);
+		for (int i=0; i<FRAMES; i+=DEVICE_BLOCK) {
+			int frames = FRAMES - i < DEVICE_BLOCK ? FRAMES - i : DEVICE_BLOCK;
+			// a device would play whatever it got, but the output has to be repeatable
+			while (nocta_stream_buffered(stream) < frames*2) {
+				nanosleep(&(struct timespec){ 0, 100000 }, NULL);
+			}
+			nocta_stream_read(stream, output + i*2, frames*2);
+		}
+		if (nocta_stream_underruns(stream)) {
+			fprintf(stderr, "%s: %u underruns\n", name, nocta_stream_underruns(stream));
+		}
+		nocta_stream_stop(stream);
+	} else {
+		for (int i=0; i<FRAMES; i+=SEQ_BLOCK) {
+			int frames = FRAMES - i < SEQ_BLOCK ? FRAMES - i : SEQ_BLOCK;
+			nocta_seq_render(seq, output + i*2, frames*2);
+		}
+	}
+	double seconds = now() - start;
+
+	result* r = &results[num_results++];
+	snprintf(r->name, sizeof(r->name), "%s", name);
+	r->checksum = checksum(output, FRAMES*2);
+	r->seconds = seconds;
+	r->voices = SEQ_TRACKS;
+
+	nocta_seq_free(seq);
+	for (int track=0; track<SEQ_TRACKS; track++) {
+		for (int i=0; i<3; i++) nocta_free(units[track][i]);
+	}
+}
+
+// write a 16-bit mono WAV file, for the sampler to map
+static void write_wav(const char* path, const int16_t* samples, uint32_t length, uint32_t rate) {
+	FILE* f = fopen(path, "wb");
+	if (!f) {
+		fprintf(stderr, "can't write %s\n", path);
+		exit(1);
+	}
+	uint32_t size = length * 2;
+	uint8_t header[44] = "RIFF....WAVEfmt ....\1\0\1\0........\2\0\20\0data";
+	uint32_t fields[][2] = { {4, 36 + size}, {16, 16}, {24, rate}, {28, rate * 2}, {40, size} };
+	for (int i=0; i<5; i++) {
+		for (int b=0; b<4; b++) header[fields[i][0] + b] = fields[i][1] >> (b * 8);
+	}
+	fwrite(header, 1, sizeof(header), f);
+	fwrite(samples, 2, length, f);
+	fclose(f);
+}
+
+// measure the spectrum of every input signal, checking the analyzer passes it
+// through unchanged, and of full scale sine waves centred on a bin, at each
+// frame size, checking that bin comes to 1.0 and the ones away from it
+// (past the Hann window's main lobe) to nothing
+#define ANALYZER_BIN 37
+#define ANALYZER_PEAK_TOLERANCE 0.001
+#define ANALYZER_FLOOR 0.0001
+
+static void run_analyzer_case(nocta_context* context, const char* name) {
+	for (int signal=0; signal<NUM_SIGNALS; signal++) {
+		nocta_unit* analyzer = nocta_analyzer(context);
+		nocta_set(analyzer, NOCTA_ANALYZER_SIZE, 11);
+		nocta_set(analyzer, NOCTA_ANALYZER_HOP, 300);
+
+		make_signal(signal);
+		memcpy(output, input, sizeof(output));
+
+		double start = now();
+		for (int i=0; i<FRAMES; i+=BLOCK) {
+			int frames = FRAMES - i < BLOCK ? FRAMES - i : BLOCK;
+			nocta_process_buffer(analyzer, output + i*2, frames*2);
+		}
+		double seconds = now() - start;
+
+		if (memcmp(output, input, sizeof(output)) != 0) {
+			fprintf(stderr, "%s: the sound was changed\n", name);
+			exit(1);
+		}
+		store_result(name, signal, seconds);
+		nocta_free(analyzer);
+	}
+
+	for (int bits=8; bits<=12; bits++) {
+		int size = 1 << bits;
+		nocta_unit* analyzer = nocta_analyzer(context);
+		nocta_set(analyzer, NOCTA_ANALYZER_SIZE, bits);
+		nocta_set(analyzer, NOCTA_ANALYZER_HOP, size);
+		for (int i=0; i<size*2; i++) {
+			output[i*2] = output[i*2+1] = lrint(32767 * sin(2 * M_PI * ANALYZER_BIN * i / size));
+		}
+		nocta_process_buffer(analyzer, output, size*2 * 2);
+
+		nocta_spectrum spectrum;
+		nocta_analyzer_read(analyzer, &spectrum);
+		if (spectrum.count != size/2 + 1 || fabs(spectrum.bins[ANALYZER_BIN] - 1) > ANALYZER_PEAK_TOLERANCE) {
+			fprintf(stderr, "%s: a full scale sine wave measured %f in %d bins of %d\n",
+			        name, spectrum.count ? spectrum.bins[ANALYZER_BIN] : 0, spectrum.count, size/2 + 1);
+			exit(1);
+		}
+		for (int i=0; i<spectrum.count; i++) {
+			if (abs(i - ANALYZER_BIN) >= 2 && spectrum.bins[i] > ANALYZER_FLOOR) {
+				fprintf(stderr, "%s: bin %d of %d measured %f, away from the sine wave's\n",
+				        name, i, size, spectrum.bins[i]);
+				exit(1);
+			}
+		}
+		nocta_free(analyzer);
+	}
+}
+
+// shift a sine wave by several amounts, and check the frequency that comes
+// out (from the time between its first and last rising zero crossings,
+// once the grains have got going) is the one asked for
+#define PITCH_FREQ 440.0
+#define PITCH_SETTLE (SAMPLE_RATE / 10)
+#define PITCH_TOLERANCE 5   // cents
+
+static void run_pitch_case(nocta_context* context, const char* name) {
+	const int shifts[] = { -1200, -500, 100, 700, 1200 };
+	for (int i=0; i<FRAMES; i++) {
+		input[i*2] = input[i*2+1] = lrint(16000 * sin(2 * M_PI * PITCH_FREQ * i / SAMPLE_RATE));
+	}
+
+	for (int s=0; s<5; s++) {
+		nocta_unit* pitch = nocta_pitch(context);
+		nocta_set(pitch, NOCTA_PITCH_SHIFT, shifts[s]);
+		memcpy(output, input, sizeof(output));
+
+		double start = now();
+		for (int i=0; i<FRAMES; i+=BLOCK) {
+			int frames = FRAMES - i < BLOCK ? FRAMES - i : BLOCK;
+			nocta_process_buffer(pitch, output + i*2, frames*2);
+		}
+		double seconds = now() - start;
+
+		double first = -1, last = -1;
+		int crossings = 0;
+		for (int i=PITCH_SETTLE; i<FRAMES; i++) {
+			int a = output[(i-1)*2], b = output[i*2];
+			if (a < 0 && b >= 0) {
+				double t = i - 1 + (double)-a / (b - a);
+				if (first < 0) first = t;
+				last = t;
+				crossings++;
+			}
+		}
+		double freq = (crossings - 1) * SAMPLE_RATE / (last - first);
+		double cents = 1200 * log2(freq / PITCH_FREQ);
+		if (crossings < 2 || fabs(cents - shifts[s]) > PITCH_TOLERANCE) {
+			fprintf(stderr, "%s: shifting by %d cents came out at %.1f Hz (%.1f cents)\n",
+			        name, shifts[s], freq, cents);
+			exit(1);
+		}
+
+		result* r = &results[num_results++];
+		snprintf(r->name, sizeof(r->name), "%s/%+d", name, shifts[s]);
+		r->checksum = checksum(output, FRAMES*2);
+		r->seconds = seconds;
+		nocta_free(pitch);
+	}
+}
+
+// play SAMPLER_VOICES looping notes at once from a mapped bank, starting and
+// releasing them at block boundaries
+#define SAMPLER_VOICES 32
+
+static void run_sampler_case(nocta_context* context, const char* name) {
+	const char* path = "golden_bank.wav";
+	static int16_t samples[16384];
+	uint32_t state = 777;
+	for (int i=0; i<16384; i++) {
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		int saw = (i * 64 % 8192) - 4096;
+		samples[i] = saw + ((int32_t)state >> 22);
+	}
+	write_wav(path, samples, 16384, 22050);
+
+	nocta_bank* bank = nocta_bank_open(path, 0);
+	remove(path); // the mapping stays valid
+	if (!bank) {
+		fprintf(stderr, "%s: bank didn't open\n", name);
+		exit(1);
+	}
+	nocta_unit* sampler = nocta_sampler(context, bank);
+	nocta_set(sampler, NOCTA_SAMPLER_VOL, 16);
+	nocta_set(sampler, NOCTA_SAMPLER_START, 1000);
+	nocta_set(sampler, NOCTA_SAMPLER_LOOP_START, 4000);
+	nocta_set(sampler, NOCTA_SAMPLER_LOOP_LENGTH, 3001);
+
+	memset(output, 0, sizeof(output));
+	double start = now();
+	for (int i=0, block=0; i<FRAMES; i+=BLOCK, block++) {
+		int frames = FRAMES - i < BLOCK ? FRAMES - i : BLOCK;
+		if (block < SAMPLER_VOICES)
+			nocta_note_on(sampler, 36 + block * 7 % 48);
+		else if (block >= 100 && block < 100 + SAMPLER_VOICES/2)
+			nocta_note_off(sampler, 36 + (block - 100) * 7 % 48);
+		nocta_process_buffer(sampler, output + i*2, frames*2);
+	}
+	double seconds = now() - start;
+
+	result* r = &results[num_results++];
+	snprintf(r->name, sizeof(r->name), "%s", name);
+	r->checksum = checksum(output, FRAMES*2);
+	r->seconds = seconds;
+	r->voices = SAMPLER_VOICES;
+
+	nocta_free(sampler);
+	nocta_bank_close(bank);
+}
+
+// a filter bank with its bands' gains going up and down, so the bands of
+// a series bank don't all cancel out to a delay
+static nocta_unit* shaped_filterbank(nocta_context* context) {
+	nocta_unit* bank = nocta_filterbank(context);
+	for (int band=0; band<32; band++) {
+		nocta_filterbank_set_gain(bank, band, band % 3 == 0 ? 230 : band % 3 == 1 ? 40 : 150);
+	}
+	return bank;
+}
+
+// boost one band of a series bank all the way, and check a sine wave at its
+// frequency comes out that much louder, and one far below it unchanged
+#define EQ_BANDS 31
+#define EQ_BAND 20
+#define EQ_LOW 31
+#define EQ_HIGH 16000
+#define EQ_TOLERANCE 0.2   // dB
+
+static double eq_level(nocta_context* context, double freq) {
+	nocta_unit* bank = nocta_filterbank(context);
+	nocta_set(bank, NOCTA_FILTERBANK_MODE, NOCTA_FILTERBANK_SERIES);
+	nocta_set(bank, NOCTA_FILTERBANK_BANDS, EQ_BANDS);
+	nocta_set(bank, NOCTA_FILTERBANK_LOW, EQ_LOW);
+	nocta_set(bank, NOCTA_FILTERBANK_HIGH, EQ_HIGH);
+	nocta_filterbank_set_gain(bank, EQ_BAND, 255);
+	for (int i=0; i<FRAMES; i++) {
+		output[i*2] = output[i*2+1] = lrint(2000 * sin(2 * M_PI * freq * i / SAMPLE_RATE));
+	}
+	nocta_process_buffer(bank, output, FRAMES*2);
+	nocta_free(bank);
+
+	// once it's settled
+	int peak = 0;
+	for (int i=FRAMES/2; i<FRAMES; i++) {
+		if (abs(output[i*2]) > peak) peak = abs(output[i*2]);
+	}
+	return 20 * log10(peak / 2000.0);
+}
+
+static void run_eq_case(nocta_context* context, const char* name) {
+	double band_freq = EQ_LOW * pow((double)EQ_HIGH / EQ_LOW, (double)EQ_BAND / (EQ_BANDS - 1));
+	double boost = (255 - 128) * 12.0 / 128;
+	double boosted = eq_level(context, band_freq);
+	double below = eq_level(context, band_freq / 16);
+	if (fabs(boosted - boost) > EQ_TOLERANCE || fabs(below) > EQ_TOLERANCE) {
+		fprintf(stderr, "%s: boosting a band by %.1f dB gave %.1f dB, and %.1f dB far below it\n",
+		        name, boost, boosted, below);
+		exit(1);
+	}
+}
+
+static void run_all(void) {
+	CASE("gainer", nocta_gainer, NOCTA_GAINER_VOL, 128);
+	CASE("gainer_pan", nocta_gainer, NOCTA_GAINER_VOL, 200, NOCTA_GAINER_PAN, -90);
+
+	const char* modes[] = { "lowpass", "highpass", "bandpass", "notch" };
+	char name[64];
+	for (int mode=0; mode<NOCTA_FILTER_NUM_MODES; mode++) {
+		snprintf(name, sizeof(name), "bqfilter_%s", modes[mode]);
+		CASE(name, nocta_bqfilter, NOCTA_FILTER_MODE, mode, NOCTA_FILTER_FREQ, 2000, NOCTA_FILTER_RES, 100);
+		snprintf(name, sizeof(name), "svfilter_%s", modes[mode]);
+		CASE(name, nocta_svfilter, NOCTA_FILTER_MODE, mode, NOCTA_FILTER_FREQ, 2000, NOCTA_FILTER_RES, 100);
+	}
+
+	CASE("filterbank_parallel", nocta_filterbank, NOCTA_FILTERBANK_MODE, NOCTA_FILTERBANK_PARALLEL);
+	CASE("filterbank_series", shaped_filterbank, NOCTA_FILTERBANK_MODE, NOCTA_FILTERBANK_SERIES, NOCTA_FILTERBANK_BANDS, 31);
+	run_eq_case(&context, "filterbank_eq");
+
+	CASE("delay", nocta_delay, NOCTA_DELAY_TIME, 20, NOCTA_DELAY_FEEDBACK, 150);
+	CASE("reverb", nocta_reverb, NOCTA_REVERB_SIZE, 100);
+	CASE("chorus", nocta_chorus, NOCTA_CHORUS_DEPTH, 100);
+	CASE("flanger", nocta_flanger, NOCTA_CHORUS_FEEDBACK, 200);
+	CASE("vibrato", nocta_vibrato, NOCTA_CHORUS_RATE, 600);
+	CASE("pitch_up", nocta_pitch, NOCTA_PITCH_SHIFT, 700);
+	CASE("pitch_down", nocta_pitch, NOCTA_PITCH_SHIFT, -1200, NOCTA_PITCH_GRAIN, 60, NOCTA_PITCH_DRY, 128);
+	CASE("compressor", nocta_compressor, NOCTA_DYNAMICS_THRESHOLD, 20, NOCTA_DYNAMICS_GAIN, 6);
+	CASE("limiter", nocta_limiter, NOCTA_DYNAMICS_THRESHOLD, 12, NOCTA_DYNAMICS_GAIN, 12);
+
+	const char* waves[] = { "saw", "sine", "square", "triangle", "noise" };
+	for (int wave=0; wave<NOCTA_NUM_WAVES; wave++) {
+		snprintf(name, sizeof(name), "osc_%s", waves[wave]);
+		CASE(name, nocta_osc, NOCTA_OSC_WAVE, wave, NOCTA_OSC_NOTE, 57, NOCTA_OSC_ACTIVE, 1);
+	}
+
+	const char* colors[] = { "white", "pink", "brown" };
+	for (int color=0; color<NOCTA_NOISE_NUM_COLORS; color++) {
+		snprintf(name, sizeof(name), "noise_%s", colors[color]);
+		CASE(name, nocta_noise, NOCTA_NOISE_COLOR, color);
+	}
+
+	FLOAT_CASE("gainer_pan", nocta_gainer, NOCTA_GAINER_VOL, 200, NOCTA_GAINER_PAN, -90);
+	FLOAT_CASE("bqfilter_lowpass", nocta_bqfilter, NOCTA_FILTER_FREQ, 2000, NOCTA_FILTER_RES, 100);
+	FLOAT_CASE("bqfilter_bandpass", nocta_bqfilter, NOCTA_FILTER_MODE, NOCTA_FILTER_MODE_BANDPASS, NOCTA_FILTER_FREQ, 100);
+	FLOAT_CASE("svfilter_lowpass", nocta_svfilter, NOCTA_FILTER_FREQ, 2000, NOCTA_FILTER_RES, 100);
+	FLOAT_CASE("svfilter_notch", nocta_svfilter, NOCTA_FILTER_MODE, NOCTA_FILTER_MODE_NOTCH, NOCTA_FILTER_FREQ, 2000);
+	FLOAT_CASE("delay", nocta_delay, NOCTA_DELAY_TIME, 20, NOCTA_DELAY_FEEDBACK, 150);
+	FLOAT_CASE("osc_saw", nocta_osc, NOCTA_OSC_WAVE, NOCTA_WAVE_SAW, NOCTA_OSC_NOTE, 57, NOCTA_OSC_ACTIVE, 1);
+	FLOAT_CASE("reverb", nocta_reverb, NOCTA_REVERB_SIZE, 100); // no float kernel, so same as fixed
+
+	run_mod_case(&context, "mod_gainer_pan", nocta_gainer, NOCTA_GAINER_PAN, -127, 127);
+	run_mod_case(&context, "mod_bqfilter_freq", nocta_bqfilter, NOCTA_FILTER_FREQ, 200, 8000);
+	run_mod_case(&context, "mod_svfilter_freq", nocta_svfilter, NOCTA_FILTER_FREQ, 200, 8000);
+	run_mod_case(&context, "mod_delay_time", nocta_delay, NOCTA_DELAY_TIME, 10, 30);
+	run_mod_case(&float_context, "float_mod_bqfilter_freq", nocta_bqfilter, NOCTA_FILTER_FREQ, 200, 8000);
+	run_mod_case(&float_context, "float_mod_svfilter_freq", nocta_svfilter, NOCTA_FILTER_FREQ, 200, 8000);
+
+	// filter frequency is followed every frame, resonance and feedback are set per block
+	const lane filter_lanes[] = {
+		LANE(NOCTA_FILTER_FREQ, {0, 200, NOCTA_CURVE_EXPONENTIAL}, {22050, 8000, NOCTA_CURVE_LINEAR},
+		     {33075, 500, NOCTA_CURVE_HOLD}, {40000, 3000}),
+		LANE(NOCTA_FILTER_RES, {0, 0}, {44100, 200})
+	};
+	const lane delay_lanes[] = {
+		LANE(NOCTA_DELAY_TIME, {0, 10}, {44100, 40}),
+		LANE(NOCTA_DELAY_FEEDBACK, {5000, 50, NOCTA_CURVE_EXPONENTIAL}, {30000, 200})
+	};
+	run_lane_case(&context, "lane_bqfilter", nocta_bqfilter, filter_lanes, 2);
+	run_lane_case(&context, "lane_svfilter", nocta_svfilter, filter_lanes, 2);
+	run_lane_case(&context, "lane_delay", nocta_delay, delay_lanes, 2);
+	run_lane_case(&float_context, "float_lane_bqfilter", nocta_bqfilter, filter_lanes, 2);
+
+	run_meter_case(&context, "meter");
+	run_limiter_case(&context, "limiter_ceiling");
+
+	run_preset_case(&context, "preset");
+	run_preset_case(&float_context, "float_preset");
+
+	run_graph_case(&context, "graph");
+	run_graph_case(&float_context, "float_graph");
+	run_fused_case(&context, "fused_graph");
+	run_fused_case(&float_context, "float_fused_graph");
+
+	run_seq_case(&context, "sequence", false);
+	run_seq_case(&float_context, "float_sequence", false);
+	run_seq_case(&context, "ahead_sequence", true);
+
+	run_sampler_case(&context, "sampler");
+
+	run_pitch_case(&context, "pitch_tuning");
+
+	run_analyzer_case(&context, "analyzer");
+	run_analyzer_case(&float_context, "float_analyzer");
+}
+
+
+// golden file:
+
+static bool find_golden(FILE* f, const char* name, uint64_t* checksum) {
+	char line[256], line_name[128];
+	unsigned long long value;
+	rewind(f);
+	while (fgets(line, sizeof(line), f)) {
+		if (sscanf(line, "%127s %llx", line_name, &value) == 2 && strcmp(line_name, name) == 0) {
+			*checksum = value;
+			return true;
+		}
+	}
+	return false;
+}
+
+int main(int argc, char* argv[]) {
+	bool update = false;
+	const char* path = "golden.txt";
+	for (int i=1; i<argc; i++) {
+		if (strcmp(argv[i], "--update") == 0) update = true;
+		else path = argv[i];
+	}
+
+	run_all();
+
+	if (update) {
+		FILE* f = fopen(path, "w");
+		if (!f) {
+			fprintf(stderr, "can't write %s\n", path);
+			return 1;
+		}
+		for (int i=0; i<num_results; i++) {
+			fprintf(f, "%s %016llx\n", results[i].name, (unsigned long long)results[i].checksum);
+		}
+		fclose(f);
+		printf("wrote %d checksums to %s\n", num_results, path);
+		return 0;
+	}
+
+	FILE* f = fopen(path, "r");
+	if (!f) {
+		fprintf(stderr, "can't read %s (run with --update to create it)\n", path);
+		return 1;
+	}
+
+	int failures = 0;
+	double total = 0;
+	for (int i=0; i<num_results; i++) {
+		result* r = &results[i];
+		uint64_t expected;
+		const char* status = "ok";
+		if (!find_golden(f, r->name, &expected)) {
+			status = "MISSING";
+			failures++;
+		} else if (expected != r->checksum) {
+			status = "FAIL";
+			failures++;
+		}
+		double realtime = (double)FRAMES / SAMPLE_RATE / r->seconds;
+		printf("%-32s %-8s %8.3f ms %8.0fx realtime", r->name, status, r->seconds * 1000, realtime);
+		if (r->voices)
+			printf(" %8.0f voices in realtime", realtime * r->voices);
+		printf("\n");
+		total += r->seconds;
+	}
+	fclose(f);
+	nocta_context_free(&context);
+	nocta_context_free(&float_context);
+
+	// only in a build with the real-time checks
+	nocta_rtcheck_stats rt;
+	if (nocta_rtcheck_read(&rt)) {
+		printf("\nreal-time checks: %u calls reported%s%s, worst block %.3f ms of %llu, "
+		       "worst load %.0f%% of real time\n",
+		       rt.violations, rt.last ? ", last " : "", rt.last ? rt.last : "",
+		       rt.worst * 1000, (unsigned long long)rt.regions, rt.worst_load * 100);
+		if (rt.violations) failures++;
+		if (rt.worst_load > RT_LOAD_BUDGET) {
+			printf("a block took over %.0f%% of its length to process\n", RT_LOAD_BUDGET * 100);
+			failures++;
+		}
+	}
+
+	printf("\n%d/%d passed, %.3f ms total\n", num_results - failures, num_results, total * 1000);
+	return failures ? 1 : 0;
+}
@@ -10,17 +10,20 @@ uint32_t wav_len, wav_pos;
 nocta_unit* filter;
 nocta_unit* gainer;
 nocta_unit* delay;
-	
-void mix(void* userdata, uint8_t* bytes, int len) {
-	memset(bytes, 0, len);
+nocta_stream* stream;
+
+// runs on the stream's worker thread, ahead of the audio callback
+void render(void* user, int16_t* buffer, size_t num_samples) {
+	uint8_t* bytes = (uint8_t*) buffer;
+	int len = num_samples * 2;
 	
 	int remaining = wav_len - wav_pos;
-	if (remaining == 0) wav_pos = 0;
+	if (remaining == 0) {
+		wav_pos = 0;
+		remaining = wav_len;
+	}
 	if (remaining < len) len = remaining;
 	
-	uint16_t* buffer = (int16_t*) bytes;
-	int num_samples = len/2;
-	
 	SDL_MixAudio(bytes, &(wav_data[wav_pos]), len, SDL_MIX_MAXVOLUME/2);
 	nocta_process_buffer(filter, buffer, num_samples);
 	nocta_process_buffer(delay, buffer, num_samples);
@@ -28,6 +31,10 @@ void mix(void* userdata, uint8_t* bytes, int len) {
 	wav_pos += len;
 }
 
+void mix(void* userdata, uint8_t* bytes, int len) {
+	nocta_stream_read(stream, (int16_t*) bytes, len/2);
+}
+
 // GUI parameters:
 
 typedef struct {
@@ -60,7 +67,6 @@ int main(int argc, char* argv[]) {
 	
 	SDL_AudioSpec wav;
 	SDL_LoadWAV("paper_isaac_sacrificial_1337.wav", &wav, &wav_data, &wav_len);
-	SDL_PauseAudio(false);
 	
 	nocta_context context = {
 		.sample_rate = spec.freq
@@ -72,6 +78,9 @@ int main(int argc, char* argv[]) {
 	nocta_set(filter, NOCTA_FILTER_FREQ, 1000);
 	nocta_set(filter, NOCTA_FILTER_RES, 100);
 	
+	// render 4 device blocks ahead
+	stream = nocta_stream_start(&context, render, NULL, spec.samples * 2, 4);
+	SDL_PauseAudio(false);
 	
 	init_gui();
 	
@@ -81,6 +90,8 @@ int main(int argc, char* argv[]) {
 	
 	close_gui();
 	SDL_CloseAudio();
+	printf("%u underruns\n", nocta_stream_underruns(stream));
+	nocta_stream_stop(stream);
 	SDL_Quit();
 }
 